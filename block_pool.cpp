@@ -0,0 +1,363 @@
+#include "block_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/*
+    这里是小对象内存池的实现代码
+*/
+
+#ifndef THREAD_POOL_NO_BLOCK_POOL
+
+namespace {
+
+const size_t MIN_BLOCK_SHIFT = 5; // 最小的块为32字节
+const size_t SIZE_CLASSES = 5;    // 32、64、128、256、512字节
+const size_t CACHE_LIMIT = 256;   // 每一级在本线程最多缓存的块数
+const size_t TRANSFER_BATCH = 64; // 本线程缓存和共享链表之间一次转移的块数
+const size_t SHARED_LIMIT = 2048; // 每一级在共享链表中最多保留的块数，超过时整批归还给全局分配器
+
+// 空闲块的前几个字节用作链表指针
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// 一串空闲块
+struct Batch {
+    FreeBlock* head;
+    size_t count;
+};
+
+size_t classOf(size_t size) {
+    size_t cls = 0;
+    while ((size_t(1) << (cls + MIN_BLOCK_SHIFT)) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+size_t blockSize(size_t cls) {
+    return size_t(1) << (cls + MIN_BLOCK_SHIFT);
+}
+
+// 把一串块归还给全局分配器，在锁外调用
+void releaseBatch(Batch batch) {
+    while (batch.head) {
+        FreeBlock* next = batch.head->next;
+        ::operator delete(batch.head);
+        batch.head = next;
+    }
+}
+
+// 计数只由所属线程写入，不需要原子的加法
+void bump(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+class ThreadCache;
+
+// 所有线程共享的空闲链表，以及用于统计的线程缓存注册表
+// 只有成批转移、线程退出和读取统计时才需要加锁
+struct SharedPool {
+    SharedPool() {
+        for (size_t cls = 0; cls < SIZE_CLASSES; cls++) {
+            partial[cls] = Batch{nullptr, 0};
+            blocks[cls] = 0;
+        }
+    }
+
+    std::mutex mtx;
+    std::vector<Batch> batches[SIZE_CLASSES];
+    Batch partial[SIZE_CLASSES]; // 线程缓存析构之后逐个释放的块，攒满一批再放入batches
+    size_t blocks[SIZE_CLASSES]; // 每一级在batches和partial中的块数
+    uint64_t released = 0;       // 超过SHARED_LIMIT而归还给全局分配器的块数
+    std::vector<ThreadCache*> caches;
+    AllocationStats retired; // 已经退出的线程的统计
+
+    // 放入一批块；这一级已经保留了SHARED_LIMIT个块时返回false，由调用者在锁外归还给全局分配器
+    // 以下两个函数调用时需持有mtx
+    bool pushLocked(size_t cls, Batch batch) {
+        if (blocks[cls] + batch.count > SHARED_LIMIT) {
+            released += batch.count;
+            return false;
+        }
+        batches[cls].push_back(batch);
+        blocks[cls] += batch.count;
+        return true;
+    }
+
+    // 取出一批块，先取整批的，没有时取partial；都没有时返回空的一批
+    Batch popLocked(size_t cls) {
+        Batch batch{nullptr, 0};
+        if (!batches[cls].empty()) {
+            batch = batches[cls].back();
+            batches[cls].pop_back();
+        } else {
+            std::swap(batch, partial[cls]);
+        }
+        blocks[cls] -= batch.count;
+        return batch;
+    }
+
+    // 线程退出之后（或者thread_local析构过程中）的分配和释放直接使用共享链表
+    void* allocate(size_t cls) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (partial[cls].count == 0 && !batches[cls].empty()) {
+                partial[cls] = batches[cls].back();
+                batches[cls].pop_back();
+            }
+            Batch& batch = partial[cls];
+            if (batch.count > 0) {
+                FreeBlock* block = batch.head;
+                batch.head = block->next;
+                batch.count--;
+                blocks[cls]--;
+                return block;
+            }
+        }
+        return ::operator new(blockSize(cls));
+    }
+
+    // 逐个释放的块先放进partial，攒满TRANSFER_BATCH个才作为一批放入共享链表，和线程缓存的转移粒度相同
+    void deallocate(void* block, size_t cls) {
+        FreeBlock* node = static_cast<FreeBlock*>(block);
+        Batch full{nullptr, 0};
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            node->next = partial[cls].head;
+            partial[cls].head = node;
+            partial[cls].count++;
+            blocks[cls]++;
+            if (partial[cls].count < TRANSFER_BATCH) {
+                return;
+            }
+            full = partial[cls];
+            partial[cls] = Batch{nullptr, 0};
+            blocks[cls] -= full.count;
+            if (pushLocked(cls, full)) {
+                return;
+            }
+        }
+        releaseBatch(full);
+    }
+};
+
+// 进程退出时可能还有线程在释放内存块，共享部分永远不析构
+SharedPool& sharedPool() {
+    static SharedPool* pool = new SharedPool();
+    return *pool;
+}
+
+// 每个线程的空闲链表和统计
+class ThreadCache {
+public:
+    ThreadCache();
+    ~ThreadCache();
+
+    void* allocate(size_t cls) {
+        bump(m_allocations);
+        if (m_heads[cls]) {
+            bump(m_localHits);
+        } else if (!refill(cls)) {
+            bump(m_heapAllocations);
+            return ::operator new(blockSize(cls));
+        }
+        FreeBlock* block = m_heads[cls];
+        m_heads[cls] = block->next;
+        m_counts[cls].store(m_counts[cls].load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return block;
+    }
+
+    void deallocate(void* block, size_t cls) {
+        bump(m_deallocations);
+        FreeBlock* node = static_cast<FreeBlock*>(block);
+        node->next = m_heads[cls];
+        m_heads[cls] = node;
+        size_t count = m_counts[cls].load(std::memory_order_relaxed) + 1;
+        m_counts[cls].store(count, std::memory_order_relaxed);
+        if (count > CACHE_LIMIT) {
+            flush(cls, TRANSFER_BATCH);
+        }
+    }
+
+    void countOversized() {
+        bump(m_oversized);
+    }
+
+    // 调用时需持有共享部分的锁
+    void addTo(AllocationStats& stats) const;
+
+private:
+    // 从共享链表取回一批块，失败时返回false
+    bool refill(size_t cls);
+    // 把链表头部的count个块交给共享链表
+    void flush(size_t cls, size_t count);
+
+    FreeBlock* m_heads[SIZE_CLASSES];
+    std::atomic<size_t> m_counts[SIZE_CLASSES];
+    std::atomic<uint64_t> m_allocations{0};
+    std::atomic<uint64_t> m_localHits{0};
+    std::atomic<uint64_t> m_sharedRefills{0};
+    std::atomic<uint64_t> m_heapAllocations{0};
+    std::atomic<uint64_t> m_oversized{0};
+    std::atomic<uint64_t> m_deallocations{0};
+};
+
+// thread_local对象析构之后不能再访问，这个标记本身不需要析构，之后仍然可以读取
+thread_local bool cacheDestroyed = false;
+
+ThreadCache* localCache() {
+    if (cacheDestroyed) {
+        return nullptr;
+    }
+    thread_local ThreadCache cache;
+    return &cache;
+}
+
+ThreadCache::ThreadCache() {
+    for (size_t cls = 0; cls < SIZE_CLASSES; cls++) {
+        m_heads[cls] = nullptr;
+        m_counts[cls] = 0;
+    }
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mtx);
+    shared.caches.push_back(this);
+}
+
+// 线程退出时缓存的块全部交给共享链表，统计累加到retired中
+ThreadCache::~ThreadCache() {
+    for (size_t cls = 0; cls < SIZE_CLASSES; cls++) {
+        flush(cls, m_counts[cls].load(std::memory_order_relaxed));
+    }
+    SharedPool& shared = sharedPool();
+    {
+        std::lock_guard<std::mutex> lock(shared.mtx);
+        addTo(shared.retired);
+        auto it = std::find(shared.caches.begin(), shared.caches.end(), this);
+        if (it != shared.caches.end()) {
+            shared.caches.erase(it);
+        }
+    }
+    cacheDestroyed = true;
+}
+
+bool ThreadCache::refill(size_t cls) {
+    SharedPool& shared = sharedPool();
+    Batch batch;
+    {
+        std::lock_guard<std::mutex> lock(shared.mtx);
+        batch = shared.popLocked(cls);
+    }
+    if (batch.count == 0) {
+        return false;
+    }
+    bump(m_sharedRefills);
+    m_heads[cls] = batch.head;
+    m_counts[cls].store(batch.count, std::memory_order_relaxed);
+    return true;
+}
+
+void ThreadCache::flush(size_t cls, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    Batch batch{m_heads[cls], count};
+    FreeBlock* last = batch.head;
+    for (size_t i = 1; i < count; i++) {
+        last = last->next;
+    }
+    m_heads[cls] = last->next;
+    last->next = nullptr;
+    m_counts[cls].store(m_counts[cls].load(std::memory_order_relaxed) - count, std::memory_order_relaxed);
+
+    SharedPool& shared = sharedPool();
+    {
+        std::lock_guard<std::mutex> lock(shared.mtx);
+        if (shared.pushLocked(cls, batch)) {
+            return;
+        }
+    }
+    releaseBatch(batch);
+}
+
+void ThreadCache::addTo(AllocationStats& stats) const {
+    stats.allocations += m_allocations.load(std::memory_order_relaxed);
+    stats.localHits += m_localHits.load(std::memory_order_relaxed);
+    stats.sharedRefills += m_sharedRefills.load(std::memory_order_relaxed);
+    stats.heapAllocations += m_heapAllocations.load(std::memory_order_relaxed);
+    stats.oversized += m_oversized.load(std::memory_order_relaxed);
+    stats.deallocations += m_deallocations.load(std::memory_order_relaxed);
+    for (size_t cls = 0; cls < SIZE_CLASSES; cls++) {
+        stats.cachedBlocks += m_counts[cls].load(std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+namespace detail {
+
+void* BlockPool::allocate(size_t size) {
+    ThreadCache* cache = localCache();
+    if (size > MAX_BLOCK_SIZE) {
+        if (cache) {
+            cache->countOversized();
+        }
+        return ::operator new(size);
+    }
+    size_t cls = classOf(size);
+    return cache ? cache->allocate(cls) : sharedPool().allocate(cls);
+}
+
+void BlockPool::deallocate(void* block, size_t size) noexcept {
+    if (!block) {
+        return;
+    }
+    if (size > MAX_BLOCK_SIZE) {
+        ::operator delete(block);
+        return;
+    }
+    size_t cls = classOf(size);
+    if (ThreadCache* cache = localCache()) {
+        cache->deallocate(block, cls);
+    } else {
+        sharedPool().deallocate(block, cls);
+    }
+}
+
+AllocationStats BlockPool::stats() {
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mtx);
+    AllocationStats stats = shared.retired;
+    for (ThreadCache* cache : shared.caches) {
+        cache->addTo(stats);
+    }
+    for (size_t cls = 0; cls < SIZE_CLASSES; cls++) {
+        stats.cachedBlocks += shared.blocks[cls];
+    }
+    stats.releasedBlocks += shared.released;
+    return stats;
+}
+
+} // namespace detail
+
+#else
+
+namespace detail {
+
+void* BlockPool::allocate(size_t size) {
+    return ::operator new(size);
+}
+
+void BlockPool::deallocate(void* block, size_t) noexcept {
+    ::operator delete(block);
+}
+
+AllocationStats BlockPool::stats() {
+    return AllocationStats();
+}
+
+} // namespace detail
+
+#endif
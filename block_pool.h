@@ -0,0 +1,104 @@
+#ifndef __BLOCK_POOL_H
+#define __BLOCK_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "pool_metrics.h"
+
+/*
+    小对象内存池：
+    Result、future的共享状态、完成回调的链表节点，以及Any和Job放不进内部缓冲区的值，每提交一个任务都要分配和释放。
+    这里把它们按大小归到几级固定大小的内存块中，每个线程有自己的空闲链表，分配和释放都不加锁；
+    本线程缓存的块超过上限时成批交给共享链表，缓存为空时再成批取回，
+    提交线程分配、工作线程释放的块就这样在线程之间流动，不会堆积在某一个线程上。
+    共享链表每一级最多保留固定数量的块，突发负载过后超出的部分整批归还给全局分配器。
+    编译时定义THREAD_POOL_NO_BLOCK_POOL可以关闭内存池，所有分配直接交给全局分配器（例如配合AddressSanitizer使用）。
+*/
+
+namespace detail {
+
+class BlockPool {
+public:
+    static const size_t MIN_BLOCK_SIZE = 32;
+    static const size_t MAX_BLOCK_SIZE = 512;
+
+    // 分配至少size字节、按max_align_t对齐的内存；超过MAX_BLOCK_SIZE时直接使用全局分配器
+    static void* allocate(size_t size);
+    // size必须和分配时相同
+    static void deallocate(void* block, size_t size) noexcept;
+
+    // 汇总所有线程的统计，加锁遍历，只用于监控
+    static AllocationStats stats();
+};
+
+// 对齐要求超过max_align_t的类型不能放进内存块
+template<typename T>
+struct IsPoolable : std::integral_constant<bool, alignof(T) <= alignof(std::max_align_t)> {};
+
+// 在内存池中构造对象，用poolDelete销毁
+template<typename T, typename... Args>
+T* poolNew(Args&&... args) {
+    if (!IsPoolable<T>::value) {
+        return new T(std::forward<Args>(args)...);
+    }
+    void* block = BlockPool::allocate(sizeof(T));
+    try {
+        return new (block) T(std::forward<Args>(args)...);
+    } catch (...) {
+        BlockPool::deallocate(block, sizeof(T));
+        throw;
+    }
+}
+
+template<typename T>
+void poolDelete(T* object) noexcept {
+    if (!IsPoolable<T>::value) {
+        delete object;
+        return;
+    }
+    object->~T();
+    BlockPool::deallocate(object, sizeof(T));
+}
+
+// 标准库风格的分配器，配合std::allocate_shared使用时控制块和对象放在同一个内存块中
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (!IsPoolable<T>::value) {
+            return std::allocator<T>().allocate(n);
+        }
+        return static_cast<T*>(BlockPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        if (!IsPoolable<T>::value) {
+            std::allocator<T>().deallocate(p, n);
+            return;
+        }
+        BlockPool::deallocate(p, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+bool operator == (const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator != (const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept {
+    return false;
+}
+
+} // namespace detail
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef __COROUTINE_H
+#define __COROUTINE_H
+
+#include "thread_pool.h"
+
+#ifndef __cpp_impl_coroutine
+#error "coroutine.h requires C++20, configure with -DTHREAD_POOL_ENABLE_COROUTINES=ON"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+/*
+    C++20协程支持：
+    co_await pool.schedule()      把当前协程转移到线程池的工作线程上继续执行
+    co_await pool.submit(...)     等待TaskFuture，任务完成后在完成它的工作线程上恢复
+    co_await result               等待submitTask返回的Result
+    CoTask<T>                     惰性启动的协程任务，可以在其他协程中co_await，也可以用spawn()投递到线程池
+    挂起的协程不占用线程，少量工作线程就可以同时推进大量未完成的操作。
+*/
+
+// pool.schedule()返回的awaiter：挂起时把恢复协程的任务投递到线程池
+// 恢复任务没有执行时（令牌被取消、超过expireAt、投递失败、关闭线程池），协程仍然会被恢复，co_await抛出TaskCancelledError
+class ScheduleAwaiter {
+public:
+    ScheduleAwaiter(ThreadPool& pool, const TaskOptions& options)
+        : m_pool(pool), m_options(options), m_status(TaskStatus::STATUS_PENDING) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    // 投递失败时恢复任务在post返回之前就已经恢复了协程，所以总是返回true；之后不能再访问*this
+    bool await_suspend(std::coroutine_handle<> handle) {
+        m_pool.post(ResumeJob(handle, this), m_options);
+        return true;
+    }
+
+    void await_resume() const {
+        if (TaskStatus::STATUS_PENDING != m_status) {
+            throw TaskCancelledError(m_status);
+        }
+    }
+
+private:
+    // 恢复协程的任务：没有执行就被销毁时，先把原因记在awaiter中再恢复协程，协程帧不会泄漏
+    class ResumeJob {
+    public:
+        ResumeJob(std::coroutine_handle<> handle, ScheduleAwaiter* awaiter) : m_handle(handle), m_awaiter(awaiter) {}
+        ResumeJob(ResumeJob&& other) noexcept
+            : m_handle(std::exchange(other.m_handle, nullptr)), m_awaiter(other.m_awaiter) {}
+        ~ResumeJob() {
+            if (m_handle) {
+                resumeWith(TaskStatus::STATUS_CANCELLED);
+            }
+        }
+
+        void operator()() {
+            std::exchange(m_handle, nullptr).resume();
+        }
+
+        // 令牌已经取消或者过期，CancellableJob跳过执行时调用
+        void cancel(TaskStatus status) {
+            resumeWith(status);
+        }
+
+    private:
+        void resumeWith(TaskStatus status) {
+            m_awaiter->m_status = status;
+            std::exchange(m_handle, nullptr).resume();
+        }
+
+        std::coroutine_handle<> m_handle;
+        ScheduleAwaiter* m_awaiter; // 位于挂起的协程帧中，恢复之前一直有效
+    };
+
+    ThreadPool& m_pool;
+    TaskOptions m_options;
+    TaskStatus m_status; // 恢复任务没有执行的原因
+};
+
+inline ScheduleAwaiter ThreadPool::schedule(const TaskOptions& options) {
+    return ScheduleAwaiter(*this, options);
+}
+
+namespace detail {
+
+// 等待TaskFuture：任务完成时由完成它的线程恢复协程
+template<typename R>
+class FutureAwaiter {
+public:
+    explicit FutureAwaiter(TaskFuture<R>&& future) : m_future(std::move(future)) {}
+
+    bool await_ready() const {
+        return m_future.ready();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return m_future.onReady([handle]() { handle.resume(); });
+    }
+
+    R await_resume() {
+        return m_future.get();
+    }
+
+private:
+    TaskFuture<R> m_future;
+};
+
+// 等待Result：提交失败的Result不会挂起，直接得到空的Any
+class ResultAwaiter {
+public:
+    explicit ResultAwaiter(std::shared_ptr<Result> result) : m_result(std::move(result)) {}
+
+    bool await_ready() const {
+        return m_result->ready();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return m_result->onReady([handle]() { handle.resume(); });
+    }
+
+    Any await_resume() {
+        return m_result->get();
+    }
+
+private:
+    std::shared_ptr<Result> m_result;
+};
+
+} // namespace detail
+
+template<typename R>
+detail::FutureAwaiter<R> operator co_await(TaskFuture<R>&& future) {
+    return detail::FutureAwaiter<R>(std::move(future));
+}
+
+inline detail::ResultAwaiter operator co_await(std::shared_ptr<Result> result) {
+    return detail::ResultAwaiter(std::move(result));
+}
+
+template<typename T = void>
+class CoTask;
+
+namespace detail {
+
+// 协程结束时恢复等待它的协程（对称转移，不会加深调用栈）
+struct CoTaskFinalAwaiter {
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct CoTaskPromiseBase {
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    CoTaskFinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        exception = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template<typename T>
+struct CoTaskPromise : CoTaskPromiseBase {
+    CoTask<T> get_return_object();
+
+    template<typename V>
+    void return_value(V&& result) {
+        value.emplace(std::forward<V>(result));
+    }
+
+    T take() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template<>
+struct CoTaskPromise<void> : CoTaskPromiseBase {
+    CoTask<void> get_return_object();
+
+    void return_void() {}
+
+    void take() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+} // namespace detail
+
+// 惰性启动的协程任务：被co_await时才开始执行，结束后恢复等待它的协程
+// 协程体内可以用co_await pool.schedule()切换到工作线程
+template<typename T>
+class CoTask {
+public:
+    using promise_type = detail::CoTaskPromise<T>;
+
+    CoTask() noexcept = default;
+    explicit CoTask(std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {}
+    ~CoTask() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    // 禁止拷贝构造和赋值
+    CoTask(const CoTask&) = delete;
+    CoTask &operator = (const CoTask&) = delete;
+
+    CoTask(CoTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    CoTask &operator = (CoTask&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    bool valid() const {
+        return static_cast<bool>(m_handle);
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    // 记录等待者后直接转移到任务协程开始执行
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    // 协程体内抛出的异常在这里重新抛出
+    T await_resume() {
+        return m_handle.promise().take();
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail {
+
+template<typename T>
+CoTask<T> CoTaskPromise<T>::get_return_object() {
+    return CoTask<T>(std::coroutine_handle<CoTaskPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object() {
+    return CoTask<void>(std::coroutine_handle<CoTaskPromise<void>>::from_promise(*this));
+}
+
+// spawn使用的驱动协程：创建后先挂起，投递到线程池后开始执行，结束时自动销毁
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() {
+            return DetachedCoroutine{ std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+        std::suspend_always initial_suspend() const noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// 恢复驱动协程的任务：关闭线程池时没有执行就被丢弃，销毁驱动协程
+class SpawnJob {
+public:
+    explicit SpawnJob(std::coroutine_handle<> handle) : m_handle(handle) {}
+    SpawnJob(SpawnJob&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    ~SpawnJob() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    void operator()() {
+        std::exchange(m_handle, nullptr).resume();
+    }
+
+private:
+    std::coroutine_handle<> m_handle;
+};
+
+// 驱动协程被销毁而没有执行完时，promise析构会让TaskFuture得到broken_promise异常
+template<typename T>
+DetachedCoroutine runSpawned(CoTask<T> task, TaskPromise<T> promise) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            promise.setValue();
+        } else {
+            promise.setValue(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+// 在线程池上启动一个协程任务，返回它的TaskFuture（可以get()，也可以在其他协程中co_await）
+template<typename T>
+TaskFuture<T> spawn(ThreadPool& pool, CoTask<T> task) {
+    auto state = new detail::FutureState<T>();
+    TaskFuture<T> future(state);
+    detail::DetachedCoroutine driver = detail::runSpawned(std::move(task), detail::TaskPromise<T>(state));
+    // 投递失败时SpawnJob随之销毁驱动协程
+    pool.post(detail::SpawnJob(driver.handle));
+    return future;
+}
+
+#endif
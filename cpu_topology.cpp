@@ -0,0 +1,151 @@
+#include "cpu_topology.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#endif
+
+CpuTopology::CpuTopology() {
+    // 默认所有CPU属于同一个节点
+    std::vector<int> cpus = currentThreadCpus();
+    if (cpus.empty()) {
+        unsigned int count = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int i = 0; i < count; i++) {
+            cpus.push_back(static_cast<int>(i));
+        }
+    }
+    for (int cpu : cpus) {
+        if (cpu >= static_cast<int>(m_cpuNode.size())) {
+            m_cpuNode.resize(cpu + 1, -1);
+        }
+        m_cpuNode[cpu] = 0;
+    }
+    m_nodes.push_back(std::move(cpus));
+}
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology topology;
+#ifdef __linux__
+    std::vector<int> allowed = currentThreadCpus();
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (!dir) {
+        return topology;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "node", 4) != 0 || !std::isdigit(static_cast<unsigned char>(entry->d_name[4]))) {
+            continue;
+        }
+        std::ifstream file(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+        std::string text;
+        if (!std::getline(file, text)) {
+            continue;
+        }
+        // 只保留进程允许使用的CPU，容器或taskset限制下不会把线程绑到不可用的CPU上
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(text)) {
+            if (allowed.empty() || std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            nodes.emplace_back(std::atoi(entry->d_name + 4), std::move(cpus));
+        }
+    }
+    closedir(dir);
+    if (nodes.empty()) {
+        return topology;
+    }
+
+    std::sort(nodes.begin(), nodes.end());
+    topology.m_nodes.clear();
+    topology.m_cpuNode.clear();
+    for (auto& node : nodes) {
+        for (int cpu : node.second) {
+            if (cpu >= static_cast<int>(topology.m_cpuNode.size())) {
+                topology.m_cpuNode.resize(cpu + 1, -1);
+            }
+            topology.m_cpuNode[cpu] = static_cast<int>(topology.m_nodes.size());
+        }
+        topology.m_nodes.push_back(std::move(node.second));
+    }
+#endif
+    return topology;
+}
+
+int CpuTopology::nodeOfCpu(int cpu) const {
+    if (cpu < 0 || cpu >= static_cast<int>(m_cpuNode.size())) {
+        return -1;
+    }
+    return m_cpuNode[cpu];
+}
+
+int CpuTopology::currentCpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+bool CpuTopology::bindCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+std::vector<int> CpuTopology::currentThreadCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+std::vector<int> CpuTopology::parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || !std::isdigit(static_cast<unsigned char>(range[0]))) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
@@ -0,0 +1,41 @@
+#ifndef __CPU_TOPOLOGY_H
+#define __CPU_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+// CPU拓扑：每个NUMA节点包含哪些CPU
+// Linux下从sysfs（/sys/devices/system/node）读取，并且只保留当前进程允许使用的CPU；
+// 其他平台或者读取失败时，所有CPU属于同一个节点
+class CpuTopology {
+public:
+    CpuTopology();
+
+    // 读取当前机器的拓扑
+    static CpuTopology detect();
+
+    size_t nodeCount() const {
+        return m_nodes.size();
+    }
+    const std::vector<int>& nodeCpus(size_t node) const {
+        return m_nodes[node];
+    }
+    // CPU所在的节点，未知时返回-1
+    int nodeOfCpu(int cpu) const;
+
+    // 当前线程正在运行的CPU，未知时返回-1
+    static int currentCpu();
+    // 把当前线程绑定到cpus上，失败或者平台不支持时返回false
+    static bool bindCurrentThread(const std::vector<int>& cpus);
+    // 当前线程允许运行的CPU
+    static std::vector<int> currentThreadCpus();
+
+    // 解析sysfs中"0-3,8-11"格式的CPU列表
+    static std::vector<int> parseCpuList(const std::string& text);
+
+private:
+    std::vector<std::vector<int>> m_nodes; // 每个节点的CPU
+    std::vector<int> m_cpuNode;            // CPU编号到节点的映射
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "executor_group.h"
+#include <algorithm>
+#include <iostream>
+
+/*
+    这里是线程预算和执行器组的实现代码
+*/
+
+struct LaneAccount {
+    LaneAccount(LaneKind kind, size_t minThreads, size_t maxThreads)
+        : kind(kind), minThreads(minThreads), maxThreads(maxThreads), threads(0), denied(0) {}
+
+    const LaneKind kind;
+    const size_t minThreads;
+    const size_t maxThreads;
+    std::atomic<size_t> threads;   // 只在m_mutex内修改，拒绝申请的快速路径不加锁读取
+    std::atomic<uint64_t> denied;
+};
+
+ThreadBudget::ThreadBudget(size_t cpuThreads, size_t blockingThreads) {
+    m_capacity[indexOf(LaneKind::LANE_CPU)] = cpuThreads;
+    m_capacity[indexOf(LaneKind::LANE_BLOCKING)] = blockingThreads;
+    m_committed[0] = m_committed[1] = 0;
+    updateExhausted(0);
+    updateExhausted(1);
+}
+
+ThreadBudget::~ThreadBudget() = default;
+
+LaneAccount* ThreadBudget::addLane(LaneKind kind, size_t minThreads, size_t maxThreads) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t k = indexOf(kind);
+    if (m_committed[k] + minThreads > m_capacity[k]) {
+        return nullptr;
+    }
+    m_committed[k] += minThreads;
+    updateExhausted(k);
+    m_lanes.emplace_back(new LaneAccount(kind, minThreads, std::max(maxThreads, minThreads)));
+    return m_lanes.back().get();
+}
+
+bool ThreadBudget::acquire(LaneAccount* lane) {
+    size_t k = indexOf(lane->kind);
+    // 已经到达通道上限，或者超出保证的部分而容量已经用完：一定会被拒绝，不加锁
+    size_t threads = lane->threads.load(std::memory_order_relaxed);
+    if (threads >= lane->maxThreads
+        || (threads >= lane->minThreads && m_exhausted[k].load(std::memory_order_acquire))) {
+        lane->denied.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    threads = lane->threads.load(std::memory_order_relaxed);
+    if (threads >= lane->maxThreads) {
+        lane->denied.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // 保证的部分在登记时已经计入，不需要再检查容量
+    if (threads < lane->minThreads) {
+        lane->threads.store(threads + 1, std::memory_order_relaxed);
+        return true;
+    }
+    if (m_committed[k] >= m_capacity[k]) {
+        lane->denied.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_committed[k]++;
+    updateExhausted(k);
+    lane->threads.store(threads + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void ThreadBudget::release(LaneAccount* lane) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t threads = lane->threads.load(std::memory_order_relaxed);
+    if (threads > lane->minThreads) {
+        size_t k = indexOf(lane->kind);
+        m_committed[k]--;
+        updateExhausted(k);
+    }
+    lane->threads.store(threads - 1, std::memory_order_relaxed);
+}
+
+void ThreadBudget::updateExhausted(size_t k) {
+    m_exhausted[k].store(m_committed[k] >= m_capacity[k], std::memory_order_release);
+}
+
+size_t ThreadBudget::capacity(LaneKind kind) const {
+    return m_capacity[indexOf(kind)];
+}
+
+size_t ThreadBudget::committed(LaneKind kind) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_committed[indexOf(kind)];
+}
+
+LaneUsage ThreadBudget::usage(const LaneAccount* lane) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    LaneUsage usage;
+    usage.kind = lane->kind;
+    usage.minThreads = lane->minThreads;
+    usage.maxThreads = lane->maxThreads;
+    usage.threads = lane->threads.load(std::memory_order_relaxed);
+    usage.borrowed = usage.threads > lane->minThreads ? usage.threads - lane->minThreads : 0;
+    usage.denied = lane->denied.load(std::memory_order_relaxed);
+    return usage;
+}
+
+ExecutorGroup::ExecutorGroup(size_t cpuThreads, size_t blockingThreads) {
+    if (cpuThreads == 0) {
+        cpuThreads = std::thread::hardware_concurrency();
+    }
+    cpuThreads = std::max<size_t>(cpuThreads, 1);
+    if (blockingThreads == 0) {
+        blockingThreads = cpuThreads * BLOCKING_THREAD_FACTOR;
+    }
+    m_budget = std::make_shared<ThreadBudget>(cpuThreads, blockingThreads);
+}
+
+ExecutorGroup::~ExecutorGroup() {
+    shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+}
+
+ThreadPool* ExecutorGroup::addLane(const std::string& name, const LaneOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Lane& lane : m_lanes) {
+        if (lane.name == name) {
+            std::cerr << "Lane creation failed: lane \"" << name << "\" already exists." << std::endl;
+            return nullptr;
+        }
+    }
+    if (options.minThreads == 0) {
+        std::cerr << "Lane creation failed: lane \"" << name << "\" needs at least one guaranteed thread." << std::endl;
+        return nullptr;
+    }
+    size_t maxThreads = PoolMode::MODE_FIXED == options.mode ? options.minThreads : options.maxThreads;
+    if (maxThreads == 0) {
+        maxThreads = m_budget->capacity(options.kind);
+    }
+    LaneAccount* account = m_budget->addLane(options.kind, options.minThreads, maxThreads);
+    if (!account) {
+        std::cerr << "Lane creation failed: not enough capacity to guarantee " << options.minThreads
+                  << " threads for lane \"" << name << "\"." << std::endl;
+        return nullptr;
+    }
+
+    std::unique_ptr<ThreadPool> pool(new ThreadPool());
+    pool->setMode(options.mode);
+    pool->setQueueMode(options.queueMode);
+    pool->setThreadSizeLimit(std::max(maxThreads, options.minThreads));
+    if (options.queueLimit > 0) {
+        pool->setTaskQueueLimit(options.queueLimit);
+    }
+    pool->setOverflowPolicy(options.overflowPolicy);
+    pool->setThreadIdleTimeout(options.idleTimeout);
+    if (options.configure) {
+        options.configure(*pool);
+    }
+    pool->setThreadBudget(m_budget, account);
+    pool->start(options.minThreads);
+
+    ThreadPool* result = pool.get();
+    m_lanes.push_back(Lane{name, account, std::move(pool)});
+    return result;
+}
+
+ThreadPool* ExecutorGroup::lane(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Lane& lane : m_lanes) {
+        if (lane.name == name) {
+            return lane.pool.get();
+        }
+    }
+    return nullptr;
+}
+
+void ExecutorGroup::shutdown(ShutdownMode mode) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_lanes.rbegin(); it != m_lanes.rend(); ++it) {
+        it->pool->shutdown(mode);
+    }
+}
+
+std::vector<LaneUsage> ExecutorGroup::usage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<LaneUsage> usages;
+    usages.reserve(m_lanes.size());
+    for (const Lane& lane : m_lanes) {
+        LaneUsage usage = m_budget->usage(lane.account);
+        usage.name = lane.name;
+        usages.push_back(std::move(usage));
+    }
+    return usages;
+}
+
+size_t ExecutorGroup::capacity(LaneKind kind) const {
+    return m_budget->capacity(kind);
+}
@@ -0,0 +1,136 @@
+#ifndef __EXECUTOR_GROUP_H
+#define __EXECUTOR_GROUP_H
+
+#include "thread_pool.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    执行器组：一个进程中的多个线程池（通道）共用一份线程预算。
+    每个通道是一个独立的ThreadPool，有自己的任务队列、队列上限、PoolMode和溢出策略，一个通道的积压不会影响其他通道的排队；
+    通道的线程数量则从组的预算中申请：
+    创建通道时预留minThreads个线程作为保证，这部分容量不会借给其他通道；
+    Cached和Adaptive模式的通道需要更多线程时，从预算中没有被预留或者借出的部分借用，线程空闲idleTimeout后退出并归还。
+    CPU通道和阻塞通道各有一份容量：CPU通道的总线程数不超过CPU数量，阻塞通道的线程大部分时间在等待I/O，
+    从另一份更大的容量中增长，不会占用CPU通道的保证或者可借用的容量。
+*/
+
+// 通道的类型，决定线程从哪一份容量中申请
+enum class LaneKind {
+    LANE_CPU,      // CPU密集的任务，和其他CPU通道共用CPU数量的线程
+    LANE_BLOCKING  // 阻塞I/O等大部分时间不占用CPU的任务，使用单独的、更大的容量
+};
+
+// ExecutorGroup::addLane的参数
+struct LaneOptions {
+    LaneKind kind = LaneKind::LANE_CPU;
+    PoolMode mode = PoolMode::MODE_FIXED;
+    QueueMode queueMode = QueueMode::QUEUE_SHARED;
+    size_t minThreads = 1;  // 保证的线程数量，启动时创建，至少为1
+    size_t maxThreads = 0;  // Cached和Adaptive模式最多的线程数量，0表示所属容量的全部；Fixed模式等于minThreads
+    size_t queueLimit = 0;  // 任务队列上限，0表示使用线程池的默认值
+    OverflowPolicy overflowPolicy = OverflowPolicy::OVERFLOW_BLOCK;
+    // 超出保证数量的线程空闲这么久后退出并归还借用的容量；比线程池默认的60s短，借出的容量很快就能被其他通道使用
+    std::chrono::steady_clock::duration idleTimeout = std::chrono::seconds(1);
+    std::function<void(ThreadPool&)> configure; // 启动之前调用，设置以上没有覆盖的选项（空闲策略、CPU绑定等）
+};
+
+// 一个通道的预算使用情况
+struct LaneUsage {
+    std::string name;
+    LaneKind kind = LaneKind::LANE_CPU;
+    size_t minThreads = 0;
+    size_t maxThreads = 0;
+    size_t threads = 0;   // 当前占用预算的线程数量
+    size_t borrowed = 0;  // 其中超出保证数量、借用的线程数量
+    uint64_t denied = 0;  // 因为容量用完而没有创建线程的次数
+};
+
+// 线程预算中一个通道的账户，由ThreadBudget::addLane创建，地址在预算销毁之前不变
+struct LaneAccount;
+
+// 线程预算：记录每个通道占用的线程数量，只在创建和退出线程时加锁
+// 已经提交的容量 = 每个通道max(占用的线程数量, 保证的数量)之和，不超过对应类型的容量，所以保证的部分总是可以取得
+// 容量用完后，Cached模式的通道每次提交都可能申请一次，一定会被拒绝的申请不加锁，只读原子变量
+class ThreadBudget {
+public:
+    ThreadBudget(size_t cpuThreads, size_t blockingThreads);
+    ~ThreadBudget();
+
+    ThreadBudget(const ThreadBudget&) = delete;
+    ThreadBudget &operator = (const ThreadBudget&) = delete;
+
+    // 登记一个通道并预留minThreads；剩余可以保证的容量不足时返回nullptr
+    LaneAccount* addLane(LaneKind kind, size_t minThreads, size_t maxThreads);
+
+    // 通道创建一个线程之前申请，超过通道上限或者没有可借用的容量时返回false
+    bool acquire(LaneAccount* lane);
+    // 线程退出后归还
+    void release(LaneAccount* lane);
+
+    size_t capacity(LaneKind kind) const;
+    // 某一类型已经预留或者借出的容量
+    size_t committed(LaneKind kind) const;
+    LaneUsage usage(const LaneAccount* lane) const;
+
+private:
+    static size_t indexOf(LaneKind kind) {
+        return LaneKind::LANE_CPU == kind ? 0 : 1;
+    }
+
+    // 提交的容量变化后更新，调用时需持有m_mutex
+    void updateExhausted(size_t k);
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<LaneAccount>> m_lanes; // 通道不会被删除
+    size_t m_capacity[2];
+    size_t m_committed[2];
+    std::atomic<bool> m_exhausted[2]; // m_committed已经达到m_capacity，没有可以借出的容量
+};
+
+// 一组按名字区分的通道，共用一个ThreadBudget
+class ExecutorGroup {
+public:
+    // blockingThreads为0时，阻塞通道的容量取cpuThreads的这么多倍
+    static const size_t BLOCKING_THREAD_FACTOR = 4;
+
+    // cpuThreads为0时取CPU数量
+    explicit ExecutorGroup(size_t cpuThreads = std::thread::hardware_concurrency(), size_t blockingThreads = 0);
+    // 按创建的相反顺序以SHUTDOWN_DRAIN关闭所有通道
+    ~ExecutorGroup();
+
+    ExecutorGroup(const ExecutorGroup&) = delete;
+    ExecutorGroup &operator = (const ExecutorGroup&) = delete;
+
+    // 创建并启动一个通道；名字重复、minThreads为0或者剩余可以保证的容量不足时返回nullptr
+    // 返回的线程池由组持有，组析构之前一直有效
+    ThreadPool* addLane(const std::string& name, const LaneOptions& options = LaneOptions());
+    // 按名字查找通道，不存在时返回nullptr
+    ThreadPool* lane(const std::string& name) const;
+
+    // 按创建的相反顺序关闭所有通道，之后提交到任何通道都会失败
+    void shutdown(ShutdownMode mode = ShutdownMode::SHUTDOWN_DRAIN);
+
+    // 每个通道的预算使用情况，按创建顺序
+    std::vector<LaneUsage> usage() const;
+    size_t capacity(LaneKind kind) const;
+
+private:
+    struct Lane {
+        std::string name;
+        LaneAccount* account;
+        std::unique_ptr<ThreadPool> pool;
+    };
+
+    std::shared_ptr<ThreadBudget> m_budget; // 通道的工作线程退出时还要归还预算，由各个线程池共同持有
+    mutable std::mutex m_mutex;
+    std::vector<Lane> m_lanes;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __MPMC_QUEUE_H
+#define __MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 有界无锁多生产者多消费者环形队列
+// 每个槽位带一个序号：序号等于入队位置时可写，等于入队位置+1时可读。
+// 生产者和消费者各自只在自己的位置计数器上做CAS，互不争用同一个缓存行。
+template<typename T>
+class MpmcQueue {
+public:
+    // 容量向上取整到2的幂，便于用掩码代替取模
+    explicit MpmcQueue(size_t size) : m_mask(roundUpPowerOfTwo(size) - 1), m_enqueuePos(0), m_dequeuePos(0) {
+        m_buffer = new Cell[m_mask + 1];
+        for (size_t i = 0; i <= m_mask; i++) {
+            m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcQueue() {
+        T item;
+        while (tryPop(item)) {}
+        delete[] m_buffer;
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue &operator = (const MpmcQueue&) = delete;
+
+    // 队列已满时返回false，不会阻塞
+    template<typename U>
+    bool tryPush(U&& item) {
+        Cell* cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // 该槽位还没有被消费，队列已满
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        new (&cell->storage) T(std::forward<U>(item));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列为空时返回false，不会阻塞
+    bool tryPop(T& item) {
+        Cell* cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // 该槽位还没有被写入，队列为空
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        T* slot = reinterpret_cast<T*>(&cell->storage);
+        item = std::move(*slot);
+        slot->~T();
+        // 槽位序号推进一整圈，留给下一轮的生产者
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+private:
+    static size_t roundUpPowerOfTwo(size_t size) {
+        size_t capacity = 2;
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    // 只读字段、入队位置、出队位置分别占据不同的缓存行
+    char m_pad0[CACHE_LINE_SIZE];
+    Cell* m_buffer;
+    const size_t m_mask;
+    char m_pad1[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_enqueuePos;
+    char m_pad2[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_dequeuePos;
+    char m_pad3[CACHE_LINE_SIZE];
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+/*
+    建立在ThreadPool之上的并行算法：parallelFor / parallelReduce / parallelTransform
+    调用线程本身也参与计算，线程池中的线程以辅助任务的形式加入。
+    每次领取的块大小 = 剩余数量 / (CHUNK_FACTOR * (参与线程数 + 空闲线程数))，不小于grain：
+    有线程空闲时切得更细，方便它们加入；线程都在忙时切得更粗，减少领取次数。
+*/
+
+namespace detail {
+
+const size_t PARALLEL_CHUNK_FACTOR = 4;
+
+// 一次并行循环的共享状态，由调用线程和所有辅助任务共同持有
+// body(begin, end) 处理下标区间 [begin, end)
+template<typename Body>
+class ParallelLoop {
+public:
+    ParallelLoop(ThreadPool& pool, size_t size, size_t grain, Body& body)
+        : m_pool(pool), m_size(size), m_grain(std::max<size_t>(grain, 1)), m_body(body), m_next(0), m_active(0) {}
+
+    // 领取并执行区间，直到没有剩余的工作
+    void participate() {
+        // 先登记为参与者再领取，保证调用线程看到 m_active == 0 之后不会再有人执行body
+        m_active++;
+        size_t begin, end;
+        while (claim(begin, end)) {
+            try {
+                m_body(begin, end);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_exception) {
+                    m_exception = std::current_exception();
+                }
+                m_next.store(m_size); // 停止分配剩余的区间
+            }
+        }
+        if (m_active.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+        }
+    }
+
+    // 调用线程：等待所有参与者执行完，并重新抛出执行过程中的第一个异常
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_active == 0; });
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+private:
+    bool claim(size_t& begin, size_t& end) {
+        size_t current = m_next.load();
+        if (current >= m_size) {
+            return false;
+        }
+        size_t workers = m_active + m_pool.getIdleThreadSize();
+        size_t chunk = std::max(m_grain, (m_size - current) / (PARALLEL_CHUNK_FACTOR * std::max<size_t>(workers, 1)));
+        begin = m_next.fetch_add(chunk);
+        if (begin >= m_size) {
+            return false;
+        }
+        end = std::min(begin + chunk, m_size);
+        return true;
+    }
+
+private:
+    ThreadPool& m_pool;
+    const size_t m_size;
+    const size_t m_grain;
+    Body& m_body;
+    std::atomic<size_t> m_next;   // 下一个未分配的下标
+    std::atomic<size_t> m_active; // 正在领取区间的参与者数量
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::exception_ptr m_exception;
+};
+
+// 把 [0, size) 分给调用线程和线程池共同执行，返回时所有区间都已处理完
+template<typename Body>
+void parallelRun(ThreadPool& pool, size_t size, size_t grain, Body& body) {
+    if (size == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (size + grain - 1) / grain;
+    if (chunks <= 1 || pool.getTotalThreadSize() == 0) {
+        body(0, size);
+        return;
+    }
+
+    auto loop = std::make_shared<ParallelLoop<Body>>(pool, size, grain, body);
+    // 辅助任务开始得晚也没关系：那时工作已经分完，它会直接返回
+    // 队列已满时不再投递，也不等待空位：调用线程自己就能完成剩余的工作
+    size_t helpers = std::min<size_t>(pool.getTotalThreadSize(), chunks - 1);
+    for (size_t i = 0; i < helpers; i++) {
+        if (!pool.tryPost([loop]() { loop->participate(); })) {
+            break;
+        }
+    }
+    loop->participate();
+    loop->wait();
+}
+
+// 下标区间直接计算下标，迭代器区间取出对应的元素
+template<typename Index, typename std::enable_if<std::is_integral<Index>::value, int>::type = 0>
+Index parallelAt(Index first, size_t i) {
+    return static_cast<Index>(first + i);
+}
+
+template<typename Iterator, typename std::enable_if<!std::is_integral<Iterator>::value, int>::type = 0>
+auto parallelAt(Iterator first, size_t i) -> decltype(first[i]) {
+    return first[i];
+}
+
+template<typename Iterator>
+void checkRandomAccess(std::true_type) {}
+
+template<typename Iterator>
+void checkRandomAccess(std::false_type) {
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+                  typename std::iterator_traits<Iterator>::iterator_category>::value,
+                  "parallel algorithms require random access iterators");
+}
+
+// 下标区间或随机访问迭代器区间的长度
+template<typename Iterator>
+size_t rangeSize(Iterator first, Iterator last) {
+    checkRandomAccess<Iterator>(std::is_integral<Iterator>());
+    return last <= first ? 0 : static_cast<size_t>(last - first);
+}
+
+} // namespace detail
+
+// 对下标区间 [first, last) 中的每个下标调用 func(i)，
+// 或者对迭代器区间 [first, last) 中的每个元素调用 func(*it)
+template<typename Iterator, typename Func>
+void parallelFor(ThreadPool& pool, Iterator first, Iterator last, Func&& func, size_t grain = 1) {
+    auto body = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            func(detail::parallelAt(first, i));
+        }
+    };
+    detail::parallelRun(pool, detail::rangeSize(first, last), grain, body);
+}
+
+// 归约：result = reduce(...reduce(init, map(x0))..., map(xn-1))
+// reduce需要满足结合律；各区间的部分结果按区间顺序合并，不要求交换律
+template<typename Iterator, typename T, typename Map, typename Reduce>
+T parallelReduce(ThreadPool& pool, Iterator first, Iterator last, T init, Map&& map, Reduce&& reduce, size_t grain = 1) {
+    size_t size = detail::rangeSize(first, last);
+    auto element = [&](size_t i) -> decltype(auto) { return map(detail::parallelAt(first, i)); };
+    std::mutex partialMutex;
+    std::vector<std::pair<size_t, T>> partials;
+    auto body = [&](size_t begin, size_t end) {
+        T partial = element(begin);
+        for (size_t i = begin + 1; i < end; i++) {
+            partial = reduce(std::move(partial), element(i));
+        }
+        std::lock_guard<std::mutex> lock(partialMutex);
+        partials.emplace_back(begin, std::move(partial));
+    };
+    detail::parallelRun(pool, size, grain, body);
+
+    std::sort(partials.begin(), partials.end(), [](const std::pair<size_t, T>& a, const std::pair<size_t, T>& b) {
+        return a.first < b.first;
+    });
+    for (auto& partial : partials) {
+        init = reduce(std::move(init), std::move(partial.second));
+    }
+    return init;
+}
+
+// 变换：*(out + i) = func(*(first + i))，返回输出区间的末尾
+template<typename InputIterator, typename OutputIterator, typename Func>
+OutputIterator parallelTransform(ThreadPool& pool, InputIterator first, InputIterator last, OutputIterator out, Func&& func, size_t grain = 1) {
+    detail::checkRandomAccess<OutputIterator>(std::false_type());
+    size_t size = detail::rangeSize(first, last);
+    auto body = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            out[i] = func(detail::parallelAt(first, i));
+        }
+    };
+    detail::parallelRun(pool, size, grain, body);
+    return out + size;
+}
+
+#endif
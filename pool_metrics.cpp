@@ -0,0 +1,111 @@
+#include "pool_metrics.h"
+#include <algorithm>
+#include <cmath>
+
+/*
+    这里是运行指标的实现代码
+*/
+
+namespace {
+
+// 最高位的1所在的位置，bits不能为0
+int highestBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(bits);
+#else
+    int index = 0;
+    while (bits >>= 1) {
+        index++;
+    }
+    return index;
+#endif
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : m_count(0), m_total(0), m_max(0) {
+    std::fill(std::begin(m_buckets), std::end(m_buckets), 0);
+}
+
+int LatencyHistogram::bucketOf(uint64_t nanos) {
+    if (nanos == 0) {
+        return 0;
+    }
+    return std::min(highestBit(nanos) + 1, BUCKETS - 1);
+}
+
+std::chrono::nanoseconds LatencyHistogram::bucketUpperBound(int bucket) {
+    if (bucket >= BUCKETS - 1) {
+        return std::chrono::nanoseconds::max();
+    }
+    return std::chrono::nanoseconds(bucket == 0 ? 0 : (1LL << bucket) - 1);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < BUCKETS; i++) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_total += other.m_total;
+    m_max = std::max(m_max, other.m_max);
+}
+
+std::chrono::nanoseconds LatencyHistogram::mean() const {
+    return std::chrono::nanoseconds(m_count ? m_total / m_count : 0);
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double p) const {
+    if (m_count == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    p = std::min(std::max(p, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * m_count)));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+void WorkerMetrics::merge(const WorkerMetrics& other) {
+    tasksExecuted += other.tasksExecuted;
+    steals += other.steals;
+    remoteSteals += other.remoteSteals;
+    spinHits += other.spinHits;
+    parks += other.parks;
+    helpedTasks += other.helpedTasks;
+    busyTime += other.busyTime;
+    idleTime += other.idleTime;
+    queueWait.merge(other.queueWait);
+    execution.merge(other.execution);
+}
+
+AtomicHistogram::AtomicHistogram() : m_count(0), m_total(0), m_max(0) {
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void AtomicHistogram::record(uint64_t nanos) {
+    m_buckets[LatencyHistogram::bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (nanos > max && !m_max.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+// 与记录并发时各个字段之间可能相差几次记录，用于监控足够了
+LatencyHistogram AtomicHistogram::load() const {
+    LatencyHistogram histogram;
+    for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        histogram.m_buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    histogram.m_count = m_count.load(std::memory_order_relaxed);
+    histogram.m_total = m_total.load(std::memory_order_relaxed);
+    histogram.m_max = m_max.load(std::memory_order_relaxed);
+    return histogram;
+}
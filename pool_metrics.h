@@ -0,0 +1,151 @@
+#ifndef __POOL_METRICS_H
+#define __POOL_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    线程池的运行指标：
+    每个工作线程槽位一份计数器，只由占用该槽位的线程写入，前后填充到缓存行之外，记录时不会与其他线程争用；
+    snapshot()读取所有槽位并汇总，不加锁，不影响正在执行的任务。
+    延迟直方图按2的幂划分桶，记录一次只需要一次位运算和几次松散序的原子加，百分位的误差在2倍以内。
+*/
+
+// 延迟直方图的快照：第0个桶统计0ns，第i个桶统计[2^(i-1), 2^i)ns，最后一个桶统计所有更大的值
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 40; // 最后一个桶从2^38ns（约275s）开始
+
+    LatencyHistogram();
+
+    // 桶的下标和上界
+    static int bucketOf(uint64_t nanos);
+    static std::chrono::nanoseconds bucketUpperBound(int bucket);
+
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const {
+        return m_count;
+    }
+    uint64_t bucketCount(int bucket) const {
+        return m_buckets[bucket];
+    }
+    std::chrono::nanoseconds total() const {
+        return std::chrono::nanoseconds(m_total);
+    }
+    std::chrono::nanoseconds max() const {
+        return std::chrono::nanoseconds(m_max);
+    }
+    std::chrono::nanoseconds mean() const;
+    // 第p（0~1）百分位所在桶的上界，不超过记录到的最大值；没有数据时返回0
+    std::chrono::nanoseconds percentile(double p) const;
+
+private:
+    friend class AtomicHistogram;
+
+    uint64_t m_buckets[BUCKETS];
+    uint64_t m_count;
+    uint64_t m_total; // 所有记录值之和（ns）
+    uint64_t m_max;
+};
+
+// 一个工作线程槽位的指标；Cached和Adaptive模式下线程退出后，后来占用同一槽位的线程继续累加
+struct WorkerMetrics {
+    int slot = -1;                 // 槽位下标，汇总值为-1
+    int node = 0;                  // 槽位所在的NUMA节点
+    uint64_t tasksExecuted = 0;    // 执行的任务数量
+    uint64_t steals = 0;           // 工作窃取模式下从其他线程队列取得的任务数量
+    uint64_t remoteSteals = 0;     // 其中来自其他NUMA节点的数量
+    uint64_t spinHits = 0;         // IDLE_SPIN_THEN_PARK模式下自旋期间等到任务、不需要睡眠的次数
+    uint64_t parks = 0;            // 没有任务、在条件变量上睡眠的次数
+    uint64_t helpedTasks = 0;      // 在任务内部等待结果期间执行的其他排队任务数量
+    std::chrono::nanoseconds busyTime{0}; // 执行任务的时间
+    std::chrono::nanoseconds idleTime{0}; // 没有任务、自旋或睡眠等待的时间
+    LatencyHistogram queueWait;    // 任务从提交到开始执行的时间
+    LatencyHistogram execution;    // 任务的执行时间
+
+    void merge(const WorkerMetrics& other);
+};
+
+// 小对象内存池的统计，进程内所有线程池共用同一组内存池
+struct AllocationStats {
+    uint64_t allocations = 0;      // 经过内存池的分配次数
+    uint64_t localHits = 0;        // 直接从本线程缓存取得的次数
+    uint64_t sharedRefills = 0;    // 本线程缓存为空、从共享空闲链表成批补充后取得的次数
+    uint64_t heapAllocations = 0;  // 共享链表也为空、向全局分配器申请新内存块的次数
+    uint64_t oversized = 0;        // 超过最大块大小、直接交给全局分配器的次数
+    uint64_t deallocations = 0;
+    uint64_t cachedBlocks = 0;     // 当前缓存在各线程和共享链表中、可以复用的内存块数量
+    uint64_t releasedBlocks = 0;   // 共享链表超过上限、归还给全局分配器的内存块数量
+
+    // 不需要向全局分配器申请内存的比例；没有分配时返回0
+    double hitRate() const {
+        uint64_t total = allocations + oversized;
+        return total ? static_cast<double>(allocations - heapAllocations) / total : 0.0;
+    }
+};
+
+// ThreadPool::snapshot()的返回值
+struct PoolMetrics {
+    std::chrono::steady_clock::time_point timestamp; // 采样时间，两次快照相减可以得到速率
+    size_t totalThreads = 0;
+    size_t idleThreads = 0;
+    size_t queuedTasks = 0;
+    uint64_t threadsCreated = 0;   // 启动以来创建的线程数量
+    uint64_t threadsRetired = 0;   // 启动以来退出（包括空闲回收）的线程数量
+    uint64_t rejectedTasks = 0;    // 因线程池停止或队列已满而提交失败的任务数量
+    uint64_t droppedTasks = 0;     // OVERFLOW_DROP_OLDEST为新任务腾出空位而丢弃的任务数量
+    uint64_t callerRunTasks = 0;   // OVERFLOW_CALLER_RUNS在提交线程上执行的任务数量
+    uint64_t cancelledTasks = 0;   // 出队时令牌已经被取消而跳过的任务数量
+    uint64_t expiredTasks = 0;     // 出队时已经过期而跳过的任务数量
+    AllocationStats allocations;   // 任务、Result和future状态使用的内存池（进程级）
+    WorkerMetrics total;           // 所有槽位的汇总
+    std::vector<WorkerMetrics> workers;
+};
+
+// 工作线程记录直方图使用的原子版本
+class AtomicHistogram {
+public:
+    AtomicHistogram();
+
+    AtomicHistogram(const AtomicHistogram&) = delete;
+    AtomicHistogram &operator = (const AtomicHistogram&) = delete;
+
+    void record(uint64_t nanos);
+    LatencyHistogram load() const;
+
+private:
+    std::atomic<uint64_t> m_buckets[LatencyHistogram::BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_max;
+};
+
+namespace detail {
+
+// 一个槽位的计数器，前后各填充一个缓存行，避免和相邻槽位或其他数据之间的伪共享
+struct WorkerStats {
+    char leadingPadding[64];
+    std::atomic<uint64_t> tasksExecuted{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> remoteSteals{0};
+    std::atomic<uint64_t> spinHits{0};
+    std::atomic<uint64_t> parks{0};
+    std::atomic<uint64_t> helpedTasks{0};
+    std::atomic<uint64_t> idleNanos{0};
+    AtomicHistogram queueWait;
+    AtomicHistogram execution;
+    char trailingPadding[64];
+
+    // 同一槽位通常只有一个写入者，松散序即可
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+};
+
+} // namespace detail
+
+#endif
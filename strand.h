@@ -0,0 +1,291 @@
+#ifndef __STRAND_H
+#define __STRAND_H
+
+#include "thread_pool.h"
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+    按key串行执行的执行器（strand）：建立在ThreadPool之上。
+    同一个key的任务按提交顺序逐个执行，前一个执行完后一个才开始；不同key的任务并行执行，用户不需要自己加锁。
+    一个key有排队的任务时才存在对应的表项，并且只有一个排空任务（drain）在线程池中执行它的队列；
+    队列排空后表项立即删除，空闲的key不占用线程，也不占用内存。
+    表项按key的哈希值分散到多个分片中，每个分片一把锁，只在入队和成批取出任务时短暂持有。
+*/
+template<typename Key, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class StrandExecutor {
+public:
+    // 一个排空任务连续执行这么多个任务之后，重新投递到线程池末尾，让其他key也有机会执行
+    static const size_t DRAIN_BATCH_LIMIT = 64;
+
+    // shardCount为0时按CPU数量选择，总是向上取整到2的幂
+    explicit StrandExecutor(ThreadPool& pool, size_t shardCount = 0)
+        : m_pool(pool), m_activeKeys(0) {
+        if (shardCount == 0) {
+            shardCount = std::max<size_t>(16, 4 * std::thread::hardware_concurrency());
+        }
+        m_shardBits = 0;
+        while ((size_t(1) << m_shardBits) < shardCount) {
+            m_shardBits++;
+        }
+        m_shards.reset(new Shard[size_t(1) << m_shardBits]);
+    }
+
+    // 等待所有已经提交的任务执行完
+    ~StrandExecutor() {
+        wait();
+    }
+
+    StrandExecutor(const StrandExecutor&) = delete;
+    StrandExecutor &operator = (const StrandExecutor&) = delete;
+
+    // 在key的队列末尾追加一个不需要返回值的任务，任务抛出的异常只输出错误信息
+    // 需要为这个key投递排空任务但是投递失败（线程池已停止或者队列已满）时返回false，这个key排队的任务都被丢弃
+    template<typename F>
+    bool post(const Key& key, F&& func) {
+        return enqueue(key, Job(ReportingJob<typename std::decay<F>::type>(std::forward<F>(func))));
+    }
+
+    // 在key的队列末尾追加一个任务，返回类型安全的TaskFuture；任务被丢弃时future得到broken_promise异常
+    template<typename F, typename... Args>
+    auto submit(const Key& key, F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>> {
+        using R = detail::InvokeResult<F, Args...>;
+        using Invoker = detail::TaskInvoker<R, typename std::decay<F>::type, typename std::decay<Args>::type...>;
+
+        auto state = new detail::FutureState<R>();
+        TaskFuture<R> future(state);
+        enqueue(key, Job(Invoker(state, std::forward<F>(func), std::forward<Args>(args)...)));
+        return future;
+    }
+
+    // 阻塞直到所有key的队列都已经排空；不能在本执行器的任务中调用
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        m_idleCond.wait(lock, [this]() { return m_activeKeys.load() == 0; });
+    }
+
+    // 当前有排队或者正在执行的任务的key数量
+    size_t activeKeys() const {
+        return m_activeKeys.load(std::memory_order_relaxed);
+    }
+
+private:
+    // key队列中的一个任务，从内存池分配
+    struct Node {
+        Job job;
+        Node* next;
+
+        static void* operator new(size_t size) { return detail::BlockPool::allocate(size); }
+        static void operator delete(void* node, size_t size) noexcept { detail::BlockPool::deallocate(node, size); }
+    };
+    static_assert(detail::IsPoolable<Node>::value, "strand nodes must fit the block pool alignment");
+
+    // 一个活跃key的任务队列（单链表），只在所属分片的锁内修改
+    struct Entry {
+        Node* head = nullptr;
+        Node* tail = nullptr;
+    };
+
+    using EntryMap = std::unordered_map<Key, Entry, Hash, KeyEqual, detail::PoolAllocator<std::pair<const Key, Entry>>>;
+
+    // 末尾填充到一个缓存行以上，避免相邻分片的锁之间的伪共享
+    struct Shard {
+        std::mutex mtx;
+        EntryMap entries;
+        char padding[64];
+    };
+
+    // post提交的任务：异常不能传给调用者，只输出错误信息，不影响同一个key后面的任务
+    template<typename Fn>
+    class ReportingJob {
+    public:
+        template<typename F>
+        explicit ReportingJob(F&& func) : m_func(std::forward<F>(func)) {}
+
+        void operator()() {
+            try {
+                m_func();
+            } catch (const std::exception& e) {
+                std::cerr << "Strand task threw an exception: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Strand task threw an unknown exception." << std::endl;
+            }
+        }
+
+    private:
+        Fn m_func;
+    };
+
+    // 正在重新投递排空任务的表项（每个线程一个）。投递期间在本线程上被执行或者被丢弃的排空任务把key交还给投递者
+    struct Reposting {
+        Entry* entry = nullptr;
+        bool handedBack = false;
+    };
+
+    static Reposting& reposting() {
+        thread_local Reposting current;
+        return current;
+    }
+
+    // 排空任务正在由本线程重新投递时，标记交还给投递者并返回true
+    static bool handBack(Entry* entry) {
+        Reposting& current = reposting();
+        if (current.entry != entry) {
+            return false;
+        }
+        current.handedBack = true;
+        return true;
+    }
+
+    // 投递到线程池的排空任务：没有执行就被丢弃时（投递失败或者关闭线程池时被取消），丢弃这个key排队的任务；
+    // 重新投递时在投递线程上直接执行或者投递失败，则交还给投递者继续排空
+    class DrainJob {
+    public:
+        DrainJob(StrandExecutor* executor, Shard* shard, Entry* entry, const Key& key)
+            : m_executor(executor), m_shard(shard), m_entry(entry), m_key(key) {}
+        DrainJob(DrainJob&& other) noexcept
+            : m_executor(other.m_executor), m_shard(other.m_shard), m_entry(other.m_entry), m_key(std::move(other.m_key)) {
+            other.m_executor = nullptr;
+        }
+        ~DrainJob() {
+            if (m_executor && !handBack(m_entry)) {
+                m_executor->discard(*m_shard, m_key);
+            }
+        }
+
+        void operator()() {
+            StrandExecutor* executor = m_executor;
+            m_executor = nullptr;
+            if (!handBack(m_entry)) {
+                executor->drain(*m_shard, m_entry, m_key);
+            }
+        }
+
+    private:
+        StrandExecutor* m_executor;
+        Shard* m_shard;
+        Entry* m_entry; // unordered_map的节点地址不会因为扩容而改变，表项只由排空任务删除
+        Key m_key;
+    };
+
+    Shard& shardOf(const Key& key) {
+        // 先打散哈希值再取高位，分片内的unordered_map取模时不会只用到一部分桶
+        uint64_t mixed = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+        return m_shards[m_shardBits ? static_cast<size_t>(mixed >> (64 - m_shardBits)) : 0];
+    }
+
+    // key已经有排空任务时只追加到队列末尾；否则创建表项并投递一个排空任务
+    bool enqueue(const Key& key, Job job) {
+        Node* node = new Node{ std::move(job), nullptr };
+        Shard& shard = shardOf(key);
+        Entry* entry;
+        bool inserted;
+        {
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            auto result = shard.entries.emplace(key, Entry());
+            entry = &result.first->second;
+            inserted = result.second;
+            if (entry->tail) {
+                entry->tail->next = node;
+            } else {
+                entry->head = node;
+            }
+            entry->tail = node;
+        }
+        if (!inserted) {
+            return true;
+        }
+        m_activeKeys.fetch_add(1);
+        // 在锁外投递，OVERFLOW_CALLER_RUNS时排空任务会直接在当前线程上执行
+        return m_pool.post(DrainJob(this, &shard, entry, key));
+    }
+
+    // 每次在锁内取走整个队列，在锁外按顺序执行；期间新提交的任务追加到表项中，下一轮再取
+    void drain(Shard& shard, Entry* entry, const Key& key) {
+        size_t executed = 0;
+        for (;;) {
+            Node* node;
+            {
+                std::lock_guard<std::mutex> lock(shard.mtx);
+                node = entry->head;
+                entry->head = entry->tail = nullptr;
+                if (!node) {
+                    shard.entries.erase(key);
+                }
+            }
+            if (!node) {
+                finishKey();
+                return;
+            }
+            while (node) {
+                Node* next = node->next;
+                node->job();
+                delete node;
+                node = next;
+                executed++;
+            }
+            if (executed >= DRAIN_BATCH_LIMIT) {
+                if (repost(shard, entry, key)) {
+                    return;
+                }
+                executed = 0;
+            }
+        }
+    }
+
+    // 把排空任务重新投递到线程池末尾，交给其他线程继续执行时返回true。
+    // 投递失败（队列已满、线程池正在关闭）或者OVERFLOW_CALLER_RUNS时在本线程上直接执行，排空任务都交还回来，
+    // 由调用者在当前栈帧中继续循环，既不丢弃排队的任务也不递归
+    bool repost(Shard& shard, Entry* entry, const Key& key) {
+        Reposting& current = reposting();
+        Reposting saved = current; // 任务内部等待时可能嵌套执行其他key的排空任务
+        current.entry = entry;
+        current.handedBack = false;
+        m_pool.post(DrainJob(this, &shard, entry, key));
+        bool handedBack = current.handedBack;
+        current = saved;
+        return !handedBack;
+    }
+
+    // 排空任务没有执行：删除表项，在锁外销毁排队的任务
+    void discard(Shard& shard, const Key& key) {
+        Node* node = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            auto it = shard.entries.find(key);
+            if (it != shard.entries.end()) {
+                node = it->second.head;
+                shard.entries.erase(it);
+            }
+        }
+        while (node) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+        finishKey();
+    }
+
+    void finishKey() {
+        if (m_activeKeys.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+            m_idleCond.notify_all();
+        }
+    }
+
+private:
+    ThreadPool& m_pool;
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_shardBits;
+    std::atomic<size_t> m_activeKeys; // 有排空任务的key数量
+    std::mutex m_idleMutex;
+    std::condition_variable m_idleCond;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef __TASK_GRAPH_H
+#define __TASK_GRAPH_H
+
+#include "thread_pool.h"
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/*
+    任务依赖图（DAG）：节点是不带参数的可调用对象，边表示执行顺序。
+    一个节点的所有前驱执行完后，由完成最后一个前驱的线程直接调度它，整个过程中没有线程阻塞等待。
+    多个后继同时就绪时，第一个在当前线程上接着执行，其余的投递到线程池。
+*/
+class TaskGraph {
+public:
+    using NodeId = size_t;
+    static const NodeId INVALID_NODE = static_cast<NodeId>(-1);
+
+    explicit TaskGraph(ThreadPool& pool) : m_pool(pool) {}
+
+    // 正在执行的节点还会访问图，析构前等待本次执行完成
+    ~TaskGraph() {
+        if (m_run) {
+            detail::helpWait(m_run->done);
+        }
+    }
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph &operator = (const TaskGraph&) = delete;
+
+    // 添加节点，返回节点编号；图正在执行时返回INVALID_NODE
+    template<typename F>
+    NodeId addNode(F&& func) {
+        if (!ready()) {
+            std::cerr << "Task graph addNode failed: graph is still running." << std::endl;
+            return INVALID_NODE;
+        }
+        m_nodes.emplace_back(Job(std::forward<F>(func)));
+        return m_nodes.size() - 1;
+    }
+
+    // 添加一条边：to在from执行完之后才会执行；图正在执行或者节点编号无效时返回false
+    bool addEdge(NodeId from, NodeId to) {
+        if (!ready()) {
+            std::cerr << "Task graph addEdge failed: graph is still running." << std::endl;
+            return false;
+        }
+        if (from >= m_nodes.size() || to >= m_nodes.size()) {
+            std::cerr << "Task graph addEdge failed: invalid node id." << std::endl;
+            return false;
+        }
+        m_nodes[from].successors.push_back(to);
+        m_nodes[to].predecessorSize++;
+        return true;
+    }
+
+    // 开始执行整个图，不会阻塞；图中有环、图正在执行或者为空时返回false
+    bool run() {
+        if (m_run && !m_run->done.ready()) {
+            std::cerr << "Task graph run failed: graph is still running." << std::endl;
+            return false;
+        }
+        if (m_nodes.empty() || hasCycle()) {
+            std::cerr << "Task graph run failed: graph is empty or has a cycle." << std::endl;
+            return false;
+        }
+        m_run = std::make_shared<GraphRun>(m_nodes);
+        for (NodeId id = 0; id < m_nodes.size(); id++) {
+            if (m_nodes[id].predecessorSize == 0) {
+                scheduleNode(m_run, id);
+            }
+        }
+        return true;
+    }
+
+    // 等待本次执行完成，并重新抛出第一个节点抛出的异常
+    // 某个节点抛出异常后，还没有开始的节点不再执行；在工作线程上调用时等待期间执行其他排队的任务
+    void wait() {
+        if (!m_run) {
+            return;
+        }
+        detail::helpWait(m_run->done);
+        if (m_run->exception) {
+            std::rethrow_exception(m_run->exception);
+        }
+    }
+
+    // 本次执行是否已经完成，不会阻塞
+    bool ready() const {
+        return !m_run || m_run->done.ready();
+    }
+
+    size_t size() const {
+        return m_nodes.size();
+    }
+
+private:
+    struct Node {
+        explicit Node(Job job) : work(std::move(job)), predecessorSize(0) {}
+        Job work;
+        std::vector<NodeId> successors;
+        size_t predecessorSize;
+    };
+
+    // 一次执行的状态，由所有已投递的节点共同持有
+    struct GraphRun {
+        explicit GraphRun(const std::vector<Node>& nodes)
+            : pending(new std::atomic<size_t>[nodes.size()]), remaining(nodes.size()), failed(false) {
+            for (size_t i = 0; i < nodes.size(); i++) {
+                pending[i].store(nodes[i].predecessorSize, std::memory_order_relaxed);
+            }
+        }
+
+        void fail(std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!exception) {
+                exception = error;
+            }
+            failed = true;
+        }
+
+        std::unique_ptr<std::atomic<size_t>[]> pending; // 每个节点还没有完成的前驱数量
+        std::atomic<size_t> remaining; // 还没有完成的节点数量
+        std::atomic<bool> failed;
+        std::mutex mutex;
+        std::exception_ptr exception;
+        OneShotEvent done;
+    };
+
+    // 投递到线程池的节点：关闭线程池时没有执行就被丢弃，也要完成计数，保证wait()能够返回
+    class NodeJob {
+    public:
+        NodeJob(TaskGraph* graph, std::shared_ptr<GraphRun> run, NodeId id)
+            : m_graph(graph), m_run(std::move(run)), m_id(id) {}
+        NodeJob(NodeJob&&) noexcept = default;
+        ~NodeJob() {
+            if (m_run) {
+                m_graph->skipNode(m_run, m_id);
+            }
+        }
+
+        void operator()() {
+            std::shared_ptr<GraphRun> run = std::move(m_run);
+            m_graph->runNode(run, m_id);
+        }
+
+    private:
+        TaskGraph* m_graph;
+        std::shared_ptr<GraphRun> m_run;
+        NodeId m_id;
+    };
+
+    void scheduleNode(const std::shared_ptr<GraphRun>& run, NodeId id) {
+        m_pool.post(NodeJob(this, run, id));
+    }
+
+    // 线程池已经停止，这个节点和后续节点只做计数
+    void skipNode(const std::shared_ptr<GraphRun>& run, NodeId id) {
+        run->fail(std::make_exception_ptr(std::runtime_error("task graph: node submission failed")));
+        runNode(run, id);
+    }
+
+    // 完成最后一个节点的线程调用done.set()之后，等待的线程可能立即销毁图，所以它必须是对图的最后一次访问
+    void runNode(const std::shared_ptr<GraphRun>& run, NodeId id) {
+        const NodeId none = m_nodes.size();
+        for (;;) {
+            if (!run->failed) {
+                try {
+                    m_nodes[id].work();
+                } catch (...) {
+                    run->fail(std::current_exception());
+                }
+            }
+            // 第一个就绪的后继留在当前线程执行，数据还在缓存中，也省去一次入队
+            NodeId next = none;
+            for (NodeId succ : m_nodes[id].successors) {
+                if (run->pending[succ].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    if (next == none) {
+                        next = succ;
+                    } else {
+                        scheduleNode(run, succ);
+                    }
+                }
+            }
+            // 留在本线程的后继还没有完成，这时remaining不会减到0
+            if (run->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                run->done.set();
+                return;
+            }
+            if (next == none) {
+                return;
+            }
+            id = next;
+        }
+    }
+
+    // 按拓扑排序检查图中是否有环
+    bool hasCycle() const {
+        std::vector<size_t> inDegree(m_nodes.size());
+        std::vector<NodeId> ready;
+        for (NodeId id = 0; id < m_nodes.size(); id++) {
+            inDegree[id] = m_nodes[id].predecessorSize;
+            if (inDegree[id] == 0) {
+                ready.push_back(id);
+            }
+        }
+        size_t visited = 0;
+        while (!ready.empty()) {
+            NodeId id = ready.back();
+            ready.pop_back();
+            visited++;
+            for (NodeId succ : m_nodes[id].successors) {
+                if (--inDegree[succ] == 0) {
+                    ready.push_back(succ);
+                }
+            }
+        }
+        return visited != m_nodes.size();
+    }
+
+private:
+    ThreadPool& m_pool;
+    std::vector<Node> m_nodes;
+    std::shared_ptr<GraphRun> m_run; // 最近一次执行的状态
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include "thread_pool.h"
+#include "parallel.h"
 #include <numeric>
 
 class MyTask : public Task {
@@ -27,7 +28,6 @@ private:
 };
  
 int main() {
-    #if 0
         {
             std::cout << "=== Testing Fixed Mode ===" << std::endl;
             ThreadPool pool;
@@ -45,10 +45,22 @@ int main() {
             int result2 = res2->get().cast<int>();
             std::cout << "Result = result1 + result2 = " << result1 + result2 << std::endl;
 
+            // 不需要继承Task，直接提交lambda
+            auto res3 = pool.submit([](int begin, int end) {
+                int sum = 0;
+                for (int i = begin; i <= end; i++) sum += i;
+                return sum;
+            }, 201, 300);
+            std::cout << "submit result = " << res3.get() << std::endl;
+
+            // 不需要手动拆分任务，由parallelReduce自动分块并汇总
+            int total = parallelReduce(pool, 0, 201, 0, [](int i) { return i; }, [](int a, int b) { return a + b; });
+            std::cout << "parallelReduce result = " << total << std::endl;
+
         }
         std::cout << "ThreadPool destroyed" << std::endl;
         std::cout << "=== Fixed Mode Test Complete ===" << std::endl;
-    #else 
+
         // Cached模式测试 - 测试线程池动态扩展功能
         std::cout << "=== Testing Cached Mode ===" << std::endl;
         {
@@ -59,7 +71,6 @@ int main() {
             std::cout << "after pool.start - Initial threads: 4" << std::endl;
 
             std::cout << "Submitting 10 tasks to test thread expansion..." << std::endl;
-            int result = 0;
             std::vector<int> results;
             for (int i = 0; i < 10; i++) {
                 pool.submitTask(std::make_shared<MyTask>(100 * i, 100 * (i + 1)));             
@@ -86,7 +97,6 @@ int main() {
         } // ThreadPool在这里被销毁
         std::cout << "ThreadPool destroyed" << std::endl;
         std::cout << "=== Cached Mode Test Complete ===" << std::endl;
-    #endif
     std::cout << "main end" << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -1,12 +1,127 @@
 #include "thread_pool.h"
+#include "timer_wheel.h"
+#include "executor_group.h"
 #include <functional>
 #include <thread>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 const size_t TASK_MAX_SIZE = 1024;
 const size_t THREAD_MAX_SIZE = 10;
 const size_t THREAD_MAX_IDLE_TIME = 60;
+const size_t DEQUEUE_BATCH_SIZE = 8;
+const size_t PRIORITY_AGING_MS = 100;
+const size_t TARGET_QUEUE_WAIT_MS = 10;
+const size_t ADAPTIVE_CONTROL_INTERVAL_MS = 50;
+const int ADAPTIVE_GROW_STREAK = 2; // 连续多少次采样都过载才增加线程
+const size_t SUBMIT_TIMEOUT_MS = 1000;
+const int SPIN_CHECK_INTERVAL = 64; // 自旋时每执行多少次pause读取一次时钟
+const int MAX_HELP_DEPTH = 128; // 等待结果期间在同一个线程栈上嵌套执行其他任务的最大层数，防止栈溢出
+
+// 线程创建、退出、回收和析构的日志，默认关闭；定义THREAD_POOL_VERBOSE后输出到std::cout
+#ifdef THREAD_POOL_VERBOSE
+#define POOL_LOG(message) (std::cout << message << std::endl)
+#else
+#define POOL_LOG(message) ((void)0)
+#endif
+
+namespace {
+// 当前线程所属的线程池以及它占用的工作队列下标，用于识别在任务内部提交的子任务
+thread_local ThreadPool* currentPool = nullptr;
+thread_local int currentWorkerSlot = -1;
+// 当前工作线程从共享队列批量取出、还没有执行的任务，等待结果时先执行它们
+thread_local std::deque<Job>* currentLocalJobs = nullptr;
+// 当前线程正在执行的带令牌任务的令牌
+thread_local const CancellationToken* currentToken = nullptr;
+// 当前线程在等待结果期间嵌套执行任务的层数
+thread_local int currentHelpDepth = 0;
+
+// 统计用的时间间隔，负数按0处理
+uint64_t toNanos(std::chrono::steady_clock::duration duration) {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    return nanos > 0 ? static_cast<uint64_t>(nanos) : 0;
+}
+
+// 告诉CPU当前在自旋等待：降低功耗，并把执行资源让给同一核心上的另一个超线程
+inline void cpuRelax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// 每个工作线程的自旋预算，按最近几次空闲时长的滑动平均调整
+// 任务通常在平均空闲时长内到达，自旋两倍的平均值就能等到大部分任务；平均空闲时长超过上限时不再自旋，直接睡眠
+class SpinBudget {
+public:
+    explicit SpinBudget(std::chrono::steady_clock::duration maxSpin)
+        : m_max(toNanos(maxSpin)), m_average(m_max / 2) {}
+
+    std::chrono::nanoseconds current() const {
+        if (m_average > m_max) {
+            return std::chrono::nanoseconds(0);
+        }
+        return std::chrono::nanoseconds(std::min(m_max, m_average * 2));
+    }
+
+    // 记录一次空闲的时长，权重1/8
+    void update(uint64_t idleNanos) {
+        // 一次很长的空闲只把平均值推到上限之外，之后的短空闲可以很快把它拉回来
+        idleNanos = std::min(idleNanos, m_max * 2);
+        m_average = m_average - m_average / 8 + idleNanos / 8;
+    }
+
+private:
+    uint64_t m_max;
+    uint64_t m_average;
+};
+
+// Result和shared_ptr的控制块一起从内存池分配
+std::shared_ptr<Result> makeResult(const std::shared_ptr<Task>& task, bool isValid) {
+    return std::allocate_shared<Result>(detail::PoolAllocator<Result>(), task, isValid);
+}
+
+// submitTask提交的任务：没有执行就被丢弃时结束对应的Result，避免get()一直等待
+class TaskJob {
+public:
+    explicit TaskJob(std::shared_ptr<Task> task) : m_task(std::move(task)) {}
+    TaskJob(TaskJob&&) noexcept = default;
+    ~TaskJob() {
+        if (m_task) {
+            m_task->cancel();
+        }
+    }
+
+    void operator()() {
+        std::shared_ptr<Task> task = std::move(m_task);
+        task->execute();
+    }
+
+    // 任务被取消或者过期，不再执行
+    void cancel(TaskStatus status) {
+        std::shared_ptr<Task> task = std::move(m_task);
+        task->cancel(status);
+    }
+
+private:
+    std::shared_ptr<Task> m_task;
+};
+}
 /*
     这里是线程池的实现代码
     线程池的主要功能是管理一组线程，并提供任务提交和执行的接口。
@@ -14,88 +129,179 @@ const size_t THREAD_MAX_IDLE_TIME = 60;
     线程池提供了任务执行、停止、重启、销毁和清理等基础功能。
 */
 
-ThreadPool::ThreadPool() : initialThreadSize(0), taskSize(0), totalThreadSize(0),
-                            taskQueueLimit(TASK_MAX_SIZE), mode(PoolMode::MODE_FIXED), 
-                            isPoolRunning(false), idleThreadSize(0), threadSizeLimit(THREAD_MAX_SIZE)
+ThreadPool::ThreadPool() : initialThreadSize(0), idleThreadSize(0), totalThreadSize(0),
+                            taskSize(0), taskQueueLimit(TASK_MAX_SIZE), threadSizeLimit(THREAD_MAX_SIZE),
+                            nextWorkerQueue(0), sleepingThreadSize(0), spinningThreadSize(0), helpingThreadSize(0),
+                            budgetAccount(nullptr),
+                            idleStrategy(IdleStrategy::IDLE_PARK), maxSpin(std::chrono::microseconds(50)),
+                            affinityMode(AffinityMode::AFFINITY_NONE),
+                            waitingSubmitterSize(0),
+                            prioritySequence(0), priorityAging(std::chrono::milliseconds(PRIORITY_AGING_MS)),
+                            timerQueue(std::make_shared<detail::TimerQueue>(*this)),
+                            threadIdleTimeout(std::chrono::seconds(THREAD_MAX_IDLE_TIME)),
+                            targetQueueWait(std::chrono::milliseconds(TARGET_QUEUE_WAIT_MS)),
+                            controllerStopping(false), metricsEnabled(true),
+                            threadsCreated(0), threadsRetired(0), rejectedTaskSize(0),
+                            droppedTaskSize(0), callerRunTaskSize(0),
+                            overflowPolicy(OverflowPolicy::OVERFLOW_BLOCK),
+                            submitTimeout(std::chrono::milliseconds(SUBMIT_TIMEOUT_MS)),
+                            highWatermark(0), lowWatermark(0), aboveHighWatermark(false),
+                            isShutdown(false), cancelPending(false), discardedTaskSize(0),
+                            mode(PoolMode::MODE_FIXED), queueMode(QueueMode::QUEUE_SHARED),
+                            dequeueBatchSize(DEQUEUE_BATCH_SIZE), isPoolRunning(false)
                             {}
 
+// 不能在自己的工作线程上析构：这个线程从任务返回后还要回到threadFunc中访问线程池
 ThreadPool::~ThreadPool() {
-    std::cout << "ThreadPool destructor called. Current thread count: " << threads.size() << std::endl;
-    
-    // 设置停止标志，停止接受新任务
-    isPoolRunning = false;
-    
-    // 等待所有任务执行完成
+    if (isWorkerThread()) {
+        std::cerr << "ThreadPool destroyed on one of its own worker threads." << std::endl;
+        std::abort();
+    }
+    POOL_LOG("ThreadPool destructor called. Current thread count: " << getTotalThreadSize());
+    shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+    // shutdown在工作线程上调用时留下了调用者自己，在这里join
+    std::vector<std::unique_ptr<Thread>> exited;
     {
-        std::unique_lock<std::mutex> lock(taskQueueMutex);
-        while (taskSize > 0) {
-            std::cout << "Waiting for " << taskSize << " tasks to complete..." << std::endl;
-            lock.unlock();
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            lock.lock();
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        exited.swap(exitedThreads);
+    }
+    for (auto& worker : exited) {
+        worker->join();
+    }
+    POOL_LOG("All threads have exited.");
+}
+
+// 关闭线程池：工作线程都是joinable的，等待最后一个线程退出后立即返回，不需要轮询
+void ThreadPool::shutdown(ShutdownMode mode) {
+    std::lock_guard<std::mutex> shutdownLock(shutdownMutex);
+    if (isShutdown) {
+        return;
+    }
+    isShutdown = true;
+
+    // 先停止定时线程和控制线程，未到期的定时任务不再投递，之后也不再增加线程
+    timerQueue->stop();
+    stopController();
+
+    std::vector<Job> discarded;
+    {
+        // 在锁内修改运行状态，正在检查条件准备睡眠的线程不会错过通知
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        isPoolRunning = false;
+        if (ShutdownMode::SHUTDOWN_CANCEL_PENDING == mode) {
+            cancelPending = true;
         }
-        std::cout << "All tasks completed." << std::endl;
     }
-    
-    // 通知所有等待的线程退出
+    if (ShutdownMode::SHUTDOWN_CANCEL_PENDING == mode) {
+        discardedTaskSize += takePendingTasks(discarded);
+    }
     notEmpty.notify_all();
     notFull.notify_all();
-    
-    // 等待所有线程自然退出
-    auto startTime = std::chrono::steady_clock::now();
-    const auto timeout = std::chrono::seconds(3); // 3秒超时
-    
-    while (!threads.empty()) {
-        auto now = std::chrono::steady_clock::now();
-        if (now - startTime > timeout) {
-            std::cout << "Timeout waiting for threads to exit, forcing cleanup" << std::endl;
-            break;
+    // 在锁外销毁丢弃的任务，它们的析构函数会结束对应的future
+    discarded.clear();
+
+    // 之后addWorkerThread不会再创建线程，取出所有线程逐个join
+    std::unordered_map<int, std::unique_ptr<Thread>> workers;
+    std::vector<std::unique_ptr<Thread>> exited;
+    {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        workers.swap(threads);
+        exited.swap(exitedThreads);
+    }
+    // 在工作线程上调用时不能join自己，放回exitedThreads，由析构函数join
+    std::unique_ptr<Thread> self;
+    for (auto& worker : workers) {
+        if (worker.second->isCurrentThread()) {
+            self = std::move(worker.second);
+        } else {
+            worker.second->join();
         }
-        
-        // 短暂等待，让线程有机会自然退出
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        
-        // 由于线程现在会自己从threads容器中删除，我们只需要等待
-        // 线程退出时会自动更新计数器并从容器中删除自己
     }
-    
-    // 最终清理 - 现在应该很少需要强制清理了
-    if (!threads.empty()) {
-        std::cout << "Forcing cleanup of remaining threads: " << threads.size() << std::endl;
-        for (auto it = threads.begin(); it != threads.end(); ++it) {
-            std::cout << "Forcing cleanup of thread " << it->first << std::endl;
+    for (auto& worker : exited) {
+        worker->join();
+    }
+    if (self) {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        exitedThreads.push_back(std::move(self));
+    }
+}
+
+size_t ThreadPool::shutdownNow() {
+    shutdown(ShutdownMode::SHUTDOWN_CANCEL_PENDING);
+    return discardedTaskSize;
+}
+
+// 取出各种队列中排队的任务，工作线程可能同时在取，取到的任务由它们执行
+size_t ThreadPool::takePendingTasks(std::vector<Job>& jobs) {
+    size_t taken = jobs.size();
+    if (isLockedQueue()) {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        size_t size = lockedQueueSize();
+        for (size_t i = 0; i < size; i++) {
+            jobs.emplace_back(popLockedTask());
+        }
+        taskSize -= size;
+    } else if (QueueMode::QUEUE_WORK_STEALING == queueMode) {
+        for (auto& queue : workerQueues) {
+            std::lock_guard<std::mutex> lock(queue->mtx);
+            size_t size = queue->jobs.size();
+            for (auto& job : queue->jobs) {
+                jobs.emplace_back(std::move(job));
+            }
+            queue->jobs.clear();
+            taskSize -= size;
+        }
+    } else if (ringQueue) {
+        for (Job job = popRingTask(); job; job = popRingTask()) {
+            jobs.emplace_back(std::move(job));
         }
-        std::unique_lock<std::mutex> lock(taskQueueMutex);
-        totalThreadSize = 0; // 重置线程总数
-        idleThreadSize = 0; // 重置空闲线程数
-        taskSize = 0; // 重置任务计数器       
-        threads.clear();
     }
-    
-    std::cout << "All threads have exited. Final thread count: " << threads.size() << std::endl;
+    return jobs.size() - taken;
 }
 
 bool ThreadPool::checkPoolRunning() const {
     return isPoolRunning;
 }
 
+void ThreadPool::setThreadBudget(std::shared_ptr<ThreadBudget> budget, LaneAccount* account) {
+    if (checkPoolRunning()) return;
+    this->threadBudget = std::move(budget);
+    this->budgetAccount = account;
+}
+
+void ThreadPool::releaseThreadBudget() {
+    if (threadBudget) {
+        threadBudget->release(budgetAccount);
+    }
+}
+
 // 设置线程池工作模式
 void ThreadPool::setMode(PoolMode mode) {
     if (checkPoolRunning()) return;
     this->mode = mode;
 }
 
+// 设置任务队列的组织方式
+void ThreadPool::setQueueMode(QueueMode mode) {
+    if (checkPoolRunning()) return;
+    this->queueMode = mode;
+}
+
+// 设置工作线程的CPU绑定方式
+void ThreadPool::setAffinityMode(AffinityMode mode) {
+    if (checkPoolRunning()) return;
+    this->affinityMode = mode;
+}
+
 // 设置线程池初始线程数量
 // void ThreadPool::setInitialThreadSize(size_t size) {
 //     this->initialThreadSize = size;
 // }
 
-// 设置taskQueue最大容纳任务数
+// 设置taskQueue最大容纳任务数，所有模式下都生效，OverflowPolicy等背压设置依赖它
 void ThreadPool::setTaskQueueLimit(size_t size) {
     if (checkPoolRunning()) return;
-    if (PoolMode::MODE_CACHED == mode) {
-        this->taskQueueLimit = size;
-    }   
+    this->taskQueueLimit = size;
 }
 
 // 设置Cached模式下的线程数量上限
@@ -103,99 +309,988 @@ void ThreadPool::setThreadSizeLimit (size_t size) {
     this->threadSizeLimit = size;
 }
 
+// 设置Cached和Adaptive模式下多余线程的空闲回收时间
+void ThreadPool::setThreadIdleTimeout(std::chrono::steady_clock::duration timeout) {
+    if (checkPoolRunning()) return;
+    this->threadIdleTimeout = std::max(timeout, std::chrono::steady_clock::duration::zero());
+}
+
+// 设置Adaptive模式下期望的任务排队时间
+void ThreadPool::setTargetQueueWait(std::chrono::steady_clock::duration wait) {
+    if (checkPoolRunning()) return;
+    this->targetQueueWait = std::max(wait, std::chrono::steady_clock::duration(1));
+}
+
+// 设置共享队列模式下工作线程每次加锁最多取出的任务数量
+void ThreadPool::setDequeueBatchSize(size_t size) {
+    if (checkPoolRunning()) return;
+    this->dequeueBatchSize = std::max<size_t>(size, 1);
+}
+
+// 设置优先级队列的老化步长
+void ThreadPool::setPriorityAging(std::chrono::steady_clock::duration step) {
+    if (checkPoolRunning()) return;
+    this->priorityAging = std::max(step, std::chrono::steady_clock::duration::zero());
+}
+
+// 设置任务队列已满时的处理方式
+void ThreadPool::setOverflowPolicy(OverflowPolicy policy) {
+    if (checkPoolRunning()) return;
+    this->overflowPolicy = policy;
+}
+
+// 设置OVERFLOW_BLOCK模式下提交者最多等待的时间
+void ThreadPool::setSubmitTimeout(std::chrono::steady_clock::duration timeout) {
+    if (checkPoolRunning()) return;
+    this->submitTimeout = std::max(timeout, std::chrono::steady_clock::duration::zero());
+}
+
+// 设置排队任务数量的高低水位线，high为0时取消
+void ThreadPool::setQueueWatermarks(size_t high, size_t low, std::function<void(QueueWatermark, size_t)> callback) {
+    if (checkPoolRunning()) return;
+    this->highWatermark = callback ? high : 0;
+    this->lowWatermark = std::min(low, high);
+    this->watermarkCallback = std::move(callback);
+}
+
+// 设置工作线程没有任务时的等待方式
+void ThreadPool::setIdleStrategy(IdleStrategy strategy, std::chrono::steady_clock::duration maxSpin) {
+    if (checkPoolRunning()) return;
+    this->idleStrategy = strategy;
+    this->maxSpin = std::max(maxSpin, std::chrono::steady_clock::duration::zero());
+}
+
+// 设置是否统计时间相关的指标
+void ThreadPool::setMetricsEnabled(bool enabled) {
+    if (checkPoolRunning()) return;
+    this->metricsEnabled = enabled;
+}
+
 // 给线程池提交任务(用户调用该接口，传入任务对象，生产任务)
-std::shared_ptr<Result> ThreadPool::submitTask(std::shared_ptr<Task> task) {
+std::shared_ptr<Result> ThreadPool::submitTask(std::shared_ptr<Task> task, const TaskOptions& options) {
     // 检查线程池是否还在运行
     if (!isPoolRunning) {
         std::cerr << "Task submission failed: thread pool is not running." << std::endl;
-        return std::make_shared<Result>(task, false);
+        return makeResult(task, false);
     }
     
-    auto result = std::make_shared<Result>(task, true);
+    auto result = makeResult(task, true);
     task->setResultPtr(result);
-    std::unique_lock<std::mutex> lock(taskQueueMutex);
-    bool Ret = notFull.wait_for(lock, std::chrono::seconds(1), [this]() {
-        return taskQueue.size() < taskQueueLimit;
-    });
-    if (!Ret) {
-        std::cerr << "Task submission failed: taskqueue is full." << std::endl;
-        return std::make_shared<Result>(task, false);
+    task->m_inlinable = !options.token.cancellable() && options.expireAt == std::chrono::steady_clock::time_point::max();
+    if (!enqueueJob(makeJob(TaskJob(task), options), options)) {
+        return makeResult(task, false);
+    }
+    return result;
+}
+
+// 批量提交任务：共享队列模式下所有任务只加一次锁，并且只唤醒需要的线程数量
+std::vector<std::shared_ptr<Result>> ThreadPool::submitBatch(const std::vector<std::shared_ptr<Task>>& tasks,
+                                                             const TaskOptions& options) {
+    std::vector<std::shared_ptr<Result>> results;
+    results.reserve(tasks.size());
+    if (!isPoolRunning) {
+        std::cerr << "Task submission failed: thread pool is not running." << std::endl;
+        for (auto& task : tasks) {
+            results.emplace_back(makeResult(task, false));
+        }
+        return results;
+    }
+
+    std::vector<Job> jobs;
+    jobs.reserve(tasks.size());
+    bool inlinable = !options.token.cancellable() && options.expireAt == std::chrono::steady_clock::time_point::max();
+    for (auto& task : tasks) {
+        auto result = makeResult(task, true);
+        task->setResultPtr(result);
+        task->m_inlinable = inlinable;
+        results.emplace_back(std::move(result));
+        jobs.emplace_back(makeJob(TaskJob(task), options));
+    }
+    // 没能放入队列的任务返回无效的Result
+    size_t pushed = enqueueJobs(jobs.data(), jobs.size(), options);
+    for (size_t i = pushed; i < tasks.size(); i++) {
+        results[i] = makeResult(tasks[i], false);
+    }
+    return results;
+}
+
+// 定时任务插入时间轮，到期后由定时线程投递到任务队列
+TimerHandle ThreadPool::scheduleJob(Job job, std::chrono::steady_clock::time_point when, std::chrono::steady_clock::duration period) {
+    if (!isPoolRunning) {
+        std::cerr << "Timer scheduling failed: thread pool is not running." << std::endl;
+        return TimerHandle();
+    }
+    auto state = std::make_shared<detail::TimerState>();
+    state->job = std::move(job);
+    if (period > std::chrono::steady_clock::duration::zero()) {
+        state->period = std::max<uint64_t>(timerQueue->toTicks(period), 1);
+    }
+    timerQueue->add(state, when);
+    return TimerHandle(timerQueue, state);
+}
+
+// 取消定时任务，线程池已经析构时定时任务早已被丢弃
+bool TimerHandle::cancel() {
+    auto queue = m_queue.lock();
+    if (!m_state || !queue) {
+        return false;
+    }
+    return queue->cancel(m_state.get());
+}
+
+bool TimerHandle::active() const {
+    return m_state && !m_state->cancelled && !m_state->fired;
+}
+
+// 把任务放入任务队列，失败时（线程池已停止或队列已满）返回false
+bool ThreadPool::enqueueJob(Job job, const TaskOptions& options) {
+    return enqueueJobs(&job, 1, options) == 1;
+}
+
+bool ThreadPool::enqueueJobFor(Job job, const TaskOptions& options, std::chrono::steady_clock::duration wait) {
+    OverflowControl overflow(OverflowPolicy::OVERFLOW_BLOCK, wait, false);
+    return enqueueJobs(&job, 1, options, overflow) == 1;
+}
+
+// 按照线程池设置的OverflowPolicy提交；OVERFLOW_REJECT只是不等待的OVERFLOW_BLOCK，预期内的失败不输出错误信息
+// 工作线程自己提交时不能阻塞等待空位：队列要靠工作线程消费，所有线程都在等待时就会死锁，改为在本线程执行
+size_t ThreadPool::enqueueJobs(Job* jobs, size_t count, const TaskOptions& options) {
+    bool reject = OverflowPolicy::OVERFLOW_REJECT == overflowPolicy;
+    OverflowPolicy policy = overflowPolicy;
+    if (reject) {
+        policy = OverflowPolicy::OVERFLOW_BLOCK;
+    } else if (OverflowPolicy::OVERFLOW_BLOCK == policy && isWorkerThread()) {
+        policy = OverflowPolicy::OVERFLOW_CALLER_RUNS;
+    }
+    OverflowControl overflow(policy, reject ? std::chrono::steady_clock::duration::zero() : submitTimeout, !reject);
+    return enqueueJobs(jobs, count, options, overflow);
+}
+
+// 按顺序把一批任务放入任务队列，返回成功放入（或者由提交线程执行）的数量
+size_t ThreadPool::enqueueJobs(Job* jobs, size_t count, const TaskOptions& options, OverflowControl& overflow) {
+    if (!isPoolRunning) {
+        std::cerr << "Task submission failed: thread pool is not running." << std::endl;
+        rejectedTaskSize.fetch_add(count, std::memory_order_relaxed);
+        return 0;
+    }
+    if (metricsEnabled) {
+        // 同一批任务共用一个入队时间
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            jobs[i].setEnqueueTime(now);
+        }
+    }
+
+    size_t pushed = 0;
+    if (!isLockedQueue()) {
+        // 工作窃取模式：任务直接进入各线程私有的队列
+        // 无锁队列模式：入队只需要一次CAS，队列满时才进入等待
+        // 两种模式都只有在需要唤醒线程或者扩容时才获取taskQueueMutex
+        if (QueueMode::QUEUE_WORK_STEALING == queueMode) {
+            while (pushed < count) {
+                size_t reserved = reserveTaskSlots(count - pushed, overflow);
+                if (reserved == 0) {
+                    break;
+                }
+                pushWorkerTasks(jobs + pushed, reserved);
+                pushed += reserved;
+            }
+        } else {
+            while (pushed < count && pushRingTask(jobs[pushed], overflow)) {
+                pushed++;
+            }
+        }
+        notifyWorkers(pushed);
+        if (needsCachedThread()) {
+            std::unique_lock<std::mutex> lock(taskQueueMutex);
+            growThreadsIfNeeded();
+        }
     } else {
-        std::cout << "Task submitted successfully." << std::endl;
+        // 同一批任务的紧急程度相同，在锁外计算一次
+        auto urgency = QueueMode::QUEUE_PRIORITY == queueMode ? taskUrgency(options) : std::chrono::steady_clock::time_point();
+        std::unique_lock<std::mutex> lock(taskQueueMutex);
+        while (pushed < count) {
+            if (lockedQueueSize() >= taskQueueLimit && !makeLockedRoom(lock, overflow)) {
+                break;
+            }
+            size_t room = std::min(count - pushed, taskQueueLimit - lockedQueueSize());
+            for (size_t i = 0; i < room; i++) {
+                pushLockedTask(std::move(jobs[pushed++]), urgency);
+            }
+            taskSize += room;
+            if (pushed < count) {
+                // 队列已满还要继续等待，先让所有线程去消费
+                notEmpty.notify_all();
+            }
+        }
+        wakeWorkers(pushed);
+
+        growThreadsIfNeeded();
     }
-    taskQueue.emplace(task);
-    taskSize++;
-    notEmpty.notify_all();
 
-    // Cached 模式 任务处理比较紧急 场景：小而快的任务 
-    // 需要根据任务数量和空闲线程的数量判断是否开启 Cached 模式
-    if (mode == PoolMode::MODE_CACHED && taskSize > idleThreadSize && totalThreadSize < threadSizeLimit) {
-        std::cout << " >>>> start a new thread. <<<< " << std::endl;
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        // threads.emplace_back(std::move(ptr));
-        int id = ptr->getThreadId();
-        threads.emplace(id, std::move(ptr));
-        
+    checkWatermarks();
+    return pushed + finishOverflow(jobs + pushed, count - pushed, overflow);
+}
+
+size_t ThreadPool::finishOverflow(Job* jobs, size_t count, OverflowControl& overflow) {
+    // 被挤出的任务在锁外销毁，它们的析构函数会结束对应的future
+    droppedTaskSize.fetch_add(overflow.dropped.size(), std::memory_order_relaxed);
+    overflow.dropped.clear();
+    if (count == 0) {
+        return 0;
+    }
+    if (OverflowPolicy::OVERFLOW_CALLER_RUNS == overflow.policy && isPoolRunning) {
+        callerRunTaskSize.fetch_add(count, std::memory_order_relaxed);
+        for (size_t i = 0; i < count; i++) {
+            jobs[i]();
+        }
+        return count;
+    }
+    if (overflow.report) {
+        std::cerr << "Task submission failed: taskqueue is full." << std::endl;
+    }
+    rejectedTaskSize.fetch_add(count, std::memory_order_relaxed);
+    return 0;
+}
+
+// 平时只是一次比较；越过水位线时用CAS翻转状态，只有翻转成功的线程调用callback
+// callback调用时不持有任何锁，可以在其中提交任务（提交又会越过水位线时，在同一个线程上嵌套收到另一种通知）
+void ThreadPool::checkWatermarks() {
+    if (highWatermark == 0) {
+        return;
+    }
+    bool above = aboveHighWatermark.load();
+    size_t size = taskSize;
+    if (!above && size >= highWatermark) {
+        if (aboveHighWatermark.compare_exchange_strong(above, true)) {
+            watermarkCallback(QueueWatermark::WATERMARK_HIGH, size);
+        }
+    } else if (above && size <= lowWatermark) {
+        if (aboveHighWatermark.compare_exchange_strong(above, false)) {
+            watermarkCallback(QueueWatermark::WATERMARK_LOW, size);
+        }
+    }
+}
+
+// Cached 模式 任务处理比较紧急 场景：小而快的任务 
+// 需要根据任务数量和空闲线程的数量判断是否开启 Cached 模式
+// 在任务内部等待结果、手上没有任务的线程会去执行排队的任务，和空闲线程一样计算
+// 工作线程在任务内部提交的子任务不创建新线程：提交者等待结果时自己会执行它们，否则递归分解的任务每一层都会创建线程
+void ThreadPool::growThreadsIfNeeded() {
+    if (needsCachedThread()) {
         // 启动线程
-        threads[id]->start(); 
+        if (Thread* thread = addWorkerThread()) {
+            POOL_LOG(" >>>> start a new thread. <<<< ");
+            thread->start();
+        }
+    }
+}
 
-        // 更新线程数量相关的值
-        totalThreadSize++;
-        idleThreadSize++;
+// 线程计数都是非负的，统一转换成size_t与任务数量和上限比较
+bool ThreadPool::needsCachedThread() const {
+    if (mode != PoolMode::MODE_CACHED) {
+        return false;
     }
+    size_t available = static_cast<size_t>(idleThreadSize + helpingThreadSize);
+    return taskSize > available && static_cast<size_t>(totalThreadSize) < threadSizeLimit && !isWorkerThread();
+}
 
-    return result;
+Thread* ThreadPool::addWorkerThread() {
+    // 空闲回收的线程在释放锁之后就不再需要任何资源，这里join不会等待
+    for (auto& exited : exitedThreads) {
+        exited->join();
+    }
+    exitedThreads.clear();
+    if (!isPoolRunning) {
+        return nullptr;
+    }
+    // ExecutorGroup的通道还要受共享预算的限制：保证的线程总能取得，超出的部分向其他通道借用
+    if (threadBudget && !threadBudget->acquire(budgetAccount)) {
+        return nullptr;
+    }
+
+    auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+    Thread* thread = ptr.get();
+    threads.emplace(ptr->getThreadId(), std::move(ptr));
+
+    // 更新线程数量相关的值
+    totalThreadSize++;
+    idleThreadSize++;
+    threadsCreated.fetch_add(1, std::memory_order_relaxed);
+    return thread;
+}
+
+// Adaptive 模式 线程的创建不在提交任务的路径上，由控制线程定期采样决定
+// 根据利特尔法则，排队时间 ≈ 排队任务数 / 吞吐量。估计的排队时间连续几次超过目标值时增加线程，
+// 一次最多翻倍；多余的线程空闲超过threadIdleTimeout后自行退出。增加和回收的条件不同，形成滞回，避免线程数量来回震荡
+void ThreadPool::controllerFunc() {
+    const auto interval = std::chrono::milliseconds(ADAPTIVE_CONTROL_INTERVAL_MS);
+    const double target = std::chrono::duration<double>(targetQueueWait).count();
+    uint64_t lastCompleted = executedTaskSize();
+    auto lastTime = std::chrono::steady_clock::now();
+    int overloadStreak = 0;
+
+    std::unique_lock<std::mutex> lock(controllerMutex);
+    while (!controllerCond.wait_for(lock, interval, [this]() { return controllerStopping; })) {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t completed = executedTaskSize();
+        double elapsed = std::chrono::duration<double>(now - lastTime).count();
+        double throughput = (completed - lastCompleted) / std::max(elapsed, 1e-6);
+        lastCompleted = completed;
+        lastTime = now;
+
+        size_t queued = taskSize;
+        int total = totalThreadSize;
+        bool overloaded = queued > 0 && idleThreadSize <= 0
+            && (throughput <= 0 || queued / throughput > target);
+        overloadStreak = overloaded ? overloadStreak + 1 : 0;
+        if (overloadStreak < ADAPTIVE_GROW_STREAK || total >= static_cast<int>(threadSizeLimit)) {
+            continue;
+        }
+        overloadStreak = 0;
+
+        // 按每个线程的平均吞吐量估计在目标时间内处理完排队任务需要的线程数量
+        size_t add = 1;
+        if (throughput > 0 && total > 0) {
+            double perThread = throughput / total;
+            double needed = queued / (perThread * target);
+            if (needed > total) {
+                add = static_cast<size_t>(needed - total);
+            }
+        }
+        add = std::max<size_t>(1, std::min<size_t>(add, std::max(total, 1)));
+        add = std::min(add, threadSizeLimit - total);
+
+        std::vector<Thread*> started;
+        {
+            std::lock_guard<std::mutex> poolLock(taskQueueMutex);
+            for (size_t i = 0; i < add; i++) {
+                if (Thread* thread = addWorkerThread()) {
+                    started.push_back(thread);
+                }
+            }
+        }
+        // 在锁外启动线程
+        for (Thread* thread : started) {
+            thread->start();
+        }
+    }
+}
+
+// 各槽位的计数只由本槽位的线程写入，控制线程采样时直接求和，工作线程之间不共享计数器
+uint64_t ThreadPool::executedTaskSize() const {
+    uint64_t size = 0;
+    for (auto& stats : workerStats) {
+        size += stats->tasksExecuted.load(std::memory_order_relaxed);
+    }
+    return size;
+}
+
+void ThreadPool::stopController() {
+    {
+        std::lock_guard<std::mutex> lock(controllerMutex);
+        controllerStopping = true;
+    }
+    controllerCond.notify_all();
+    if (controllerThread.joinable()) {
+        controllerThread.join();
+    }
+}
+
+// 预留最多count个任务名额，保证工作窃取模式下任务总数不超过taskQueueLimit
+size_t ThreadPool::reserveTaskSlots(size_t count, OverflowControl& overflow) {
+    size_t reserved = 0;
+    auto tryReserve = [&]() {
+        size_t size = taskSize.load();
+        while (size < taskQueueLimit) {
+            reserved = std::min(count, taskQueueLimit - size);
+            if (taskSize.compare_exchange_weak(size, size + reserved)) {
+                return true;
+            }
+        }
+        reserved = 0;
+        return false;
+    };
+    if (count == 0 || tryReserve()) {
+        return reserved;
+    }
+    if (OverflowPolicy::OVERFLOW_DROP_OLDEST == overflow.policy) {
+        // 已经预留但还没有放入队列的名额不能丢弃，这时没有可以丢弃的任务
+        while (dropOldestWorkerTask(overflow.dropped)) {
+            if (tryReserve()) {
+                return reserved;
+            }
+        }
+    }
+    if (OverflowPolicy::OVERFLOW_BLOCK != overflow.policy) {
+        return 0;
+    }
+    // 任务数量已达上限，先确保有线程在消费，再等待
+    std::unique_lock<std::mutex> lock(taskQueueMutex);
+    wakeWorkers(taskSize);
+    notFull.wait_until(lock, overflow.deadline(), [&]() { return tryReserve() || !isPoolRunning; });
+    return reserved;
+}
+
+bool ThreadPool::dropOldestWorkerTask(std::vector<Job>& dropped) {
+    size_t start = nextWorkerQueue.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < workerQueues.size(); i++) {
+        WorkerQueue& queue = *workerQueues[(start + i) % workerQueues.size()];
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        if (!queue.jobs.empty()) {
+            dropped.emplace_back(std::move(queue.jobs.front()));
+            queue.jobs.pop_front();
+            taskSize--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::pushWorkerTasks(Job* jobs, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (currentPool == this && currentWorkerSlot >= 0) {
+        // 任务内部提交的子任务放入本线程队列，数据还在缓存中，可以马上被本线程执行
+        WorkerQueue& queue = *workerQueues[currentWorkerSlot];
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        for (size_t i = 0; i < count; i++) {
+            queue.jobs.push_back(std::move(jobs[i]));
+        }
+        return;
+    }
+    // 外部提交的任务按顺序切成若干段，轮流放入提交线程所在节点的各个队列，每个队列只加一次锁
+    const std::vector<int>& group = localWorkerSlots();
+    size_t queueSize = group.size();
+    size_t chunks = std::min(count, queueSize);
+    size_t start = nextWorkerQueue.fetch_add(chunks, std::memory_order_relaxed);
+    size_t index = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        size_t end = count * (c + 1) / chunks;
+        WorkerQueue& queue = *workerQueues[group[(start + c) % queueSize]];
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        for (; index < end; index++) {
+            queue.jobs.push_back(std::move(jobs[index]));
+        }
+    }
+}
+
+Job ThreadPool::popWorkerTask(int slot) {
+    Job job;
+    {
+        WorkerQueue& queue = *workerQueues[slot];
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+    }
+    // 本线程队列为空，从其他线程队列的头部窃取最早提交的任务，先本节点后其他节点
+    const std::vector<int>& victims = workerPlacements[slot].stealOrder;
+    for (size_t i = 0; !job && i < victims.size(); i++) {
+        WorkerQueue& victim = *workerQueues[victims[i]];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            detail::WorkerStats& stats = *workerStats[slot];
+            detail::WorkerStats::add(stats.steals, 1);
+            if (workerPlacements[victims[i]].node != workerPlacements[slot].node) {
+                detail::WorkerStats::add(stats.remoteSteals, 1);
+            }
+        }
+    }
+    if (job && taskSize.fetch_sub(1) >= taskQueueLimit) {
+        // 之前任务已满，可能有提交者在等待
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        notFull.notify_all();
+    }
+    return job;
+}
+
+bool ThreadPool::pushRingTask(Job& job, OverflowControl& overflow) {
+    // 先增加计数再入队，保证出队时的减操作不会早于这里的加操作
+    auto tryPush = [&]() {
+        taskSize++;
+        if (ringQueue->tryPush(std::move(job))) {
+            return true;
+        }
+        taskSize--;
+        return false;
+    };
+    if (tryPush()) {
+        return true;
+    }
+    if (OverflowPolicy::OVERFLOW_DROP_OLDEST == overflow.policy) {
+        // 从队列头部挤出最早的任务，空出的位置可能被其他提交者抢走，因此循环
+        Job oldest;
+        while (ringQueue->tryPop(oldest)) {
+            taskSize--;
+            overflow.dropped.emplace_back(std::move(oldest));
+            if (tryPush()) {
+                return true;
+            }
+        }
+    }
+    if (OverflowPolicy::OVERFLOW_BLOCK != overflow.policy) {
+        return false;
+    }
+    // 队列已满，先确保有线程在消费，再等待
+    std::unique_lock<std::mutex> lock(taskQueueMutex);
+    wakeWorkers(taskSize);
+    waitingSubmitterSize++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool pushed = false;
+    notFull.wait_until(lock, overflow.deadline(), [&]() { return !isPoolRunning || (pushed = tryPush()); });
+    waitingSubmitterSize--;
+    return pushed;
+}
+
+Job ThreadPool::popRingTask() {
+    Job job;
+    if (!ringQueue->tryPop(job)) {
+        return Job();
+    }
+    taskSize--;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waitingSubmitterSize > 0) {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        notFull.notify_all();
+    }
+    return job;
+}
+
+// 只有存在睡眠线程时才需要加锁通知，避免每次提交都争用taskQueueMutex
+// 任务计数在这之前已经增加：自旋的线程在减少spinningThreadSize之后还会再检查一次任务计数，
+// 这里读到它还在自旋时，它一定能看到新任务，不需要唤醒
+void ThreadPool::notifyWorkers(size_t count) {
+    size_t spinning = std::max(spinningThreadSize.load(), 0);
+    if (count > spinning && (sleepingThreadSize > 0 || helpingThreadSize > 0)) {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        wakeWorkers(count);
+    }
+}
+
+// 最多唤醒count个睡眠的线程，正在自旋的线程不需要唤醒，调用时需持有taskQueueMutex
+// 睡眠的线程不够时，再打断阻塞在结果上的工作线程，让它们执行剩下的任务
+void ThreadPool::wakeWorkers(size_t count) {
+    size_t spinning = std::max(spinningThreadSize.load(), 0);
+    count = count > spinning ? count - spinning : 0;
+    size_t sleeping = static_cast<size_t>(std::max(sleepingThreadSize.load(), 0));
+    if (count == 0) {
+        return;
+    }
+    if (sleeping > 0) {
+        if (count >= sleeping) {
+            notEmpty.notify_all();
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                notEmpty.notify_one();
+            }
+        }
+    }
+    for (size_t i = sleeping; i < count && i - sleeping < helpingEvents.size(); i++) {
+        helpingEvents[i - sleeping]->interrupt();
+    }
+}
+
+// 前一半预算执行pause指令，后一半每次检查之后让出CPU，都只读取任务计数，不加锁
+bool ThreadPool::spinForTask(std::chrono::nanoseconds budget) {
+    if (budget <= std::chrono::nanoseconds::zero()) {
+        return false;
+    }
+    spinningThreadSize++;
+    auto start = std::chrono::steady_clock::now();
+    auto yieldTime = start + budget / 2;
+    auto endTime = start + budget;
+    bool found = false;
+    while (!found) {
+        for (int i = 0; i < SPIN_CHECK_INTERVAL; i++) {
+            if (taskSize > 0 || !isPoolRunning) {
+                found = true;
+                break;
+            }
+            cpuRelax();
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (found || now >= endTime) {
+            break;
+        }
+        if (now >= yieldTime) {
+            std::this_thread::yield();
+        }
+    }
+    spinningThreadSize--;
+    return found;
+}
+
+bool ThreadPool::isWorkerThread() const {
+    return currentPool == this && currentWorkerSlot >= 0;
+}
+
+bool ThreadPool::hasPendingTask() const {
+    if (!isLockedQueue()) {
+        return taskSize > 0;
+    }
+    return lockedQueueSize() > 0;
+}
+
+bool ThreadPool::isLockedQueue() const {
+    return QueueMode::QUEUE_SHARED == queueMode || QueueMode::QUEUE_PRIORITY == queueMode;
+}
+
+size_t ThreadPool::lockedQueueSize() const {
+    return QueueMode::QUEUE_PRIORITY == queueMode ? priorityQueue.size() : taskQueue.size();
+}
+
+// 优先级队列是二叉堆，入队和出队都是O(log n)
+void ThreadPool::pushLockedTask(Job job, std::chrono::steady_clock::time_point urgency) {
+    if (QueueMode::QUEUE_PRIORITY != queueMode) {
+        taskQueue.emplace(std::move(job));
+        return;
+    }
+    priorityQueue.push_back(PriorityJob{std::move(job), urgency, prioritySequence++});
+    std::push_heap(priorityQueue.begin(), priorityQueue.end(), &ThreadPool::lessUrgent);
+}
+
+bool ThreadPool::makeLockedRoom(std::unique_lock<std::mutex>& lock, OverflowControl& overflow) {
+    if (OverflowPolicy::OVERFLOW_DROP_OLDEST == overflow.policy) {
+        // 队列上限为0时没有可以挤出的任务，按拒绝处理
+        if (lockedQueueSize() == 0) {
+            return false;
+        }
+        if (QueueMode::QUEUE_PRIORITY != queueMode) {
+            overflow.dropped.emplace_back(popLockedTask());
+        } else {
+            // 最不紧急的任务一定在堆的叶子中，和末尾的元素交换后取出
+            // 换过来的末尾元素原来也是叶子，放到叶子位置上只需要向上调整，O(log n)
+            auto leaves = priorityQueue.begin() + priorityQueue.size() / 2;
+            auto victim = std::min_element(leaves, priorityQueue.end(), &ThreadPool::lessUrgent);
+            size_t index = victim - priorityQueue.begin();
+            std::iter_swap(victim, priorityQueue.end() - 1);
+            overflow.dropped.emplace_back(std::move(priorityQueue.back().job));
+            priorityQueue.pop_back();
+            if (index < priorityQueue.size()) {
+                std::push_heap(priorityQueue.begin(), priorityQueue.begin() + index + 1, &ThreadPool::lessUrgent);
+            }
+        }
+        taskSize--;
+        return true;
+    }
+    if (OverflowPolicy::OVERFLOW_BLOCK != overflow.policy) {
+        return false;
+    }
+    bool ready = notFull.wait_until(lock, overflow.deadline(), [this]() {
+        return lockedQueueSize() < taskQueueLimit || !isPoolRunning;
+    });
+    return ready && isPoolRunning;
+}
+
+Job ThreadPool::popLockedTask() {
+    Job job;
+    if (QueueMode::QUEUE_PRIORITY != queueMode) {
+        job = std::move(taskQueue.front());
+        taskQueue.pop();
+        return job;
+    }
+    std::pop_heap(priorityQueue.begin(), priorityQueue.end(), &ThreadPool::lessUrgent);
+    job = std::move(priorityQueue.back().job);
+    priorityQueue.pop_back();
+    return job;
+}
+
+bool ThreadPool::lessUrgent(const PriorityJob& a, const PriorityJob& b) {
+    if (a.urgency != b.urgency) {
+        return a.urgency > b.urgency;
+    }
+    return a.sequence > b.sequence;
+}
+
+// 虚拟截止时间 = 提交时间 + 优先级等级 * 老化步长，有显式截止时间时取较早的一个
+std::chrono::steady_clock::time_point ThreadPool::taskUrgency(const TaskOptions& options) const {
+    auto urgency = std::chrono::steady_clock::now() + priorityAging * static_cast<int>(options.priority);
+    return std::min(urgency, options.deadline);
+}
+
+// 槽位轮流分配到各个节点，Cached模式下先启动的线程也能均匀分布在所有节点上
+// 工作队列和统计数据由绑定到对应节点的线程分配，按照首次访问策略其内存位于该节点
+void ThreadPool::placeWorkerSlots(size_t slotSize) {
+    bool pinned = AffinityMode::AFFINITY_NONE != affinityMode;
+    topology = pinned ? CpuTopology::detect() : CpuTopology();
+    size_t nodeSize = pinned ? topology.nodeCount() : 1;
+
+    workerPlacements.assign(slotSize, WorkerPlacement());
+    nodeWorkerSlots.assign(nodeSize, std::vector<int>());
+    allWorkerSlots.clear();
+    for (size_t i = 0; i < slotSize; i++) {
+        WorkerPlacement& placement = workerPlacements[i];
+        placement.node = static_cast<int>(i % nodeSize);
+        if (pinned) {
+            const std::vector<int>& cpus = topology.nodeCpus(placement.node);
+            if (AffinityMode::AFFINITY_CPU == affinityMode) {
+                placement.cpus.push_back(cpus[(i / nodeSize) % cpus.size()]);
+            } else {
+                placement.cpus = cpus;
+            }
+        }
+        nodeWorkerSlots[placement.node].push_back(static_cast<int>(i));
+        allWorkerSlots.push_back(static_cast<int>(i));
+    }
+    for (size_t i = 0; i < slotSize; i++) {
+        WorkerPlacement& placement = workerPlacements[i];
+        for (size_t n = 0; n < nodeSize; n++) {
+            const std::vector<int>& group = nodeWorkerSlots[(placement.node + n) % nodeSize];
+            // 同一节点内从自己的下一个槽位开始，让各线程窃取的起点错开
+            size_t offset = std::find(group.begin(), group.end(), static_cast<int>(i)) - group.begin();
+            for (size_t k = 0; k < group.size(); k++) {
+                int victim = group[(offset + k) % group.size()];
+                if (victim != static_cast<int>(i)) {
+                    placement.stealOrder.push_back(victim);
+                }
+            }
+        }
+    }
+
+    workerQueues.clear();
+    workerStats.clear();
+    workerQueues.resize(slotSize);
+    workerStats.resize(slotSize);
+    auto allocate = [this](size_t node) {
+        for (int slot : nodeWorkerSlots[node]) {
+            workerQueues[slot] = std::make_unique<WorkerQueue>();
+            workerStats[slot] = std::make_unique<detail::WorkerStats>();
+        }
+    };
+    if (!pinned) {
+        allocate(0);
+        return;
+    }
+    // 每个节点由一个绑定到该节点的临时线程分配，调用线程的CPU绑定保持不变；
+    // 工作线程启动前全部分配完，其他线程访问任意槽位时不需要同步
+    std::vector<std::thread> allocators;
+    for (size_t n = 0; n < nodeSize; n++) {
+        allocators.emplace_back([this, &allocate, n]() {
+            CpuTopology::bindCurrentThread(topology.nodeCpus(n));
+            allocate(n);
+        });
+    }
+    for (auto& allocator : allocators) {
+        allocator.join();
+    }
+}
+
+const std::vector<int>& ThreadPool::localWorkerSlots() const {
+    if (nodeWorkerSlots.size() > 1) {
+        int node = topology.nodeOfCpu(CpuTopology::currentCpu());
+        if (node >= 0 && node < static_cast<int>(nodeWorkerSlots.size()) && !nodeWorkerSlots[node].empty()) {
+            return nodeWorkerSlots[node];
+        }
+    }
+    return allWorkerSlots;
+}
+
+// 为线程分配一个工作队列，优先选择没有被占用的队列
+int ThreadPool::acquireWorkerSlot() {
+    auto it = std::min_element(workerSlotUsers.begin(), workerSlotUsers.end());
+    (*it)++;
+    return static_cast<int>(it - workerSlotUsers.begin());
+}
+
+void ThreadPool::releaseWorkerSlot(int slot) {
+    workerSlotUsers[slot]--;
 }
 
 // 启动线程池
 void ThreadPool::start(size_t initialThreadSize) {
+    {
+        // 定时线程已经停止，关闭后不能再次启动
+        std::lock_guard<std::mutex> lock(shutdownMutex);
+        if (isShutdown) {
+            std::cerr << "Thread pool start failed: thread pool has been shut down." << std::endl;
+            return;
+        }
+        // 再次启动会重新分配工作队列和统计数据，并覆盖正在运行的控制线程
+        if (isPoolRunning) {
+            std::cerr << "Thread pool start failed: thread pool is already running." << std::endl;
+            return;
+        }
+    }
     isPoolRunning = true;
     this->initialThreadSize = initialThreadSize;
-    this->totalThreadSize = initialThreadSize;
-    for (int i = 0; i < initialThreadSize; i++)
+
+    // 每个线程对应一个工作队列，Cached模式按线程数量上限预先分配
+    size_t slotSize = initialThreadSize;
+    if (PoolMode::MODE_FIXED != mode) {
+        slotSize = std::max(initialThreadSize, threadSizeLimit);
+    }
+    slotSize = std::max<size_t>(slotSize, 1);
+    placeWorkerSlots(slotSize);
+    workerSlotUsers.assign(slotSize, 0);
+
+    // 无锁环形队列的容量由taskQueueLimit决定（向上取整到2的幂）
+    if (QueueMode::QUEUE_LOCK_FREE == queueMode) {
+        ringQueue = std::make_unique<MpmcQueue<Job>>(taskQueueLimit);
+    }
+
+    for (size_t i = 0; i < initialThreadSize; i++)
     {
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        int id = ptr->getThreadId();
-        threads.emplace(id, std::move(ptr));
-        threads[id]->start();
-        idleThreadSize++;
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        if (Thread* thread = addWorkerThread()) {
+            thread->start();
+        }
+    }
+
+    if (PoolMode::MODE_ADAPTIVE == mode) {
+        controllerThread = std::thread(&ThreadPool::controllerFunc, this);
     }
 }
 
+size_t ThreadPool::getTotalThreadSize() const {
+    int size = totalThreadSize;
+    return size > 0 ? size : 0;
+}
+
+size_t ThreadPool::getIdleThreadSize() const {
+    int size = idleThreadSize;
+    return size > 0 ? size : 0;
+}
+
+// workerStats在start()之后不再变化，读取时不需要加锁
+PoolMetrics ThreadPool::snapshot() const {
+    PoolMetrics metrics;
+    metrics.timestamp = std::chrono::steady_clock::now();
+    metrics.totalThreads = getTotalThreadSize();
+    metrics.idleThreads = getIdleThreadSize();
+    metrics.queuedTasks = taskSize;
+    metrics.threadsCreated = threadsCreated.load(std::memory_order_relaxed);
+    metrics.threadsRetired = threadsRetired.load(std::memory_order_relaxed);
+    metrics.rejectedTasks = rejectedTaskSize.load(std::memory_order_relaxed);
+    metrics.droppedTasks = droppedTaskSize.load(std::memory_order_relaxed);
+    metrics.callerRunTasks = callerRunTaskSize.load(std::memory_order_relaxed);
+    metrics.cancelledTasks = skippedTasks.cancelled.load(std::memory_order_relaxed);
+    metrics.expiredTasks = skippedTasks.expired.load(std::memory_order_relaxed);
+    metrics.allocations = detail::BlockPool::stats();
+    metrics.workers.reserve(workerStats.size());
+    for (size_t i = 0; i < workerStats.size(); i++) {
+        const detail::WorkerStats& stats = *workerStats[i];
+        WorkerMetrics worker;
+        worker.slot = static_cast<int>(i);
+        worker.node = workerPlacements[i].node;
+        worker.tasksExecuted = stats.tasksExecuted.load(std::memory_order_relaxed);
+        worker.steals = stats.steals.load(std::memory_order_relaxed);
+        worker.remoteSteals = stats.remoteSteals.load(std::memory_order_relaxed);
+        worker.spinHits = stats.spinHits.load(std::memory_order_relaxed);
+        worker.parks = stats.parks.load(std::memory_order_relaxed);
+        worker.helpedTasks = stats.helpedTasks.load(std::memory_order_relaxed);
+        worker.idleTime = std::chrono::nanoseconds(stats.idleNanos.load(std::memory_order_relaxed));
+        worker.queueWait = stats.queueWait.load();
+        worker.execution = stats.execution.load();
+        worker.busyTime = worker.execution.total();
+        metrics.total.merge(worker);
+        metrics.workers.push_back(std::move(worker));
+    }
+    return metrics;
+}
+
 // 定义线程函数 线程池的所有线程从任务队列里面消费任务
 void ThreadPool::threadFunc(int threadId) {
-    auto lastTime = std::chrono::high_resolution_clock::now();
-    while (isPoolRunning) {
-        std::shared_ptr<Task> task;
-        {
+    int slot;
+    {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        slot = acquireWorkerSlot();
+    }
+    currentPool = this;
+    currentWorkerSlot = slot;
+    detail::WorkerStats& stats = *workerStats[slot];
+
+    // 在使用栈之前绑定CPU，之后栈页面在首次访问时分配在本节点上
+    if (AffinityMode::AFFINITY_NONE != affinityMode) {
+        CpuTopology::bindCurrentThread(workerPlacements[slot].cpus);
+    }
+
+    // 共享队列模式下一次取出的多个任务，先在本地依次执行
+    std::deque<Job> localJobs;
+    currentLocalJobs = &localJobs;
+    bool spinning = IdleStrategy::IDLE_SPIN_THEN_PARK == idleStrategy;
+    SpinBudget spinBudget(maxSpin);
+
+    auto lastTime = std::chrono::steady_clock::now();
+    // 线程池停止后，仍然要把已经提交的任务执行完再退出
+    while (isPoolRunning || taskSize > 0 || !localJobs.empty()) {
+        Job job;
+        if (!localJobs.empty() && cancelPending) {
+            // 关闭时取消排队的任务，已经批量取出但还没开始执行的也一起丢弃
+            discardedTaskSize += localJobs.size();
+            localJobs.clear();
+            continue;
+        }
+        if (!localJobs.empty()) {
+            job = std::move(localJobs.front());
+            localJobs.pop_front();
+        } else if (QueueMode::QUEUE_WORK_STEALING == queueMode) {
+            job = popWorkerTask(slot);
+        } else if (QueueMode::QUEUE_LOCK_FREE == queueMode) {
+            job = popRingTask();
+        }
+
+        if (!job) {
+            bool timed = metricsEnabled || spinning;
+            auto idleStart = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            // 先自旋等待，大部分任务在这期间到达时不需要加锁，也不需要提交者唤醒
+            bool spun = spinning && spinForTask(spinBudget.current());
+            if (spun) {
+                detail::WorkerStats::add(stats.spinHits, 1);
+                if (!isLockedQueue()) {
+                    uint64_t idle = toNanos(std::chrono::steady_clock::now() - idleStart);
+                    spinBudget.update(idle);
+                    if (metricsEnabled) {
+                        detail::WorkerStats::add(stats.idleNanos, idle);
+                    }
+                    continue;
+                }
+            }
             std::unique_lock<std::mutex> lock(taskQueueMutex);
             
-            // 在cached模式下，有可能已经创建了许多线程，但是空闲时间可能超过60s
+            // 在cached和adaptive模式下，有可能已经创建了许多线程，但是空闲时间可能超过threadIdleTimeout
             // 那么应该把多余的线程进行回收
-            // 如果当前时间 - 上一次线程执行的时间 > 60s
-            while (taskQueue.empty() && isPoolRunning) {
-                if (PoolMode::MODE_CACHED == mode) {
+            // 直接等到空闲超时的时间点，中间不会为了检查超时而醒来
+            sleepingThreadSize++;
+            if (!hasPendingTask() && isPoolRunning) {
+                detail::WorkerStats::add(stats.parks, 1);
+            }
+            while (!hasPendingTask() && isPoolRunning) {
+                // Fixed模式下只有等待结果时临时增加的线程超过初始数量，它们同样在空闲超时后退出
+                if (PoolMode::MODE_FIXED != mode || static_cast<size_t>(totalThreadSize) > initialThreadSize) {
                     // 等待任务，如果超时则检查是否需要回收线程
-                    if (std::cv_status::timeout == notEmpty.wait_for(lock, std::chrono::seconds(1))) {
-                        auto now = std::chrono::high_resolution_clock::now();
-                        auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-                        if (duration.count() >= THREAD_MAX_IDLE_TIME && totalThreadSize > initialThreadSize) {
+                    auto deadline = lastTime + threadIdleTimeout;
+                    if (std::cv_status::timeout == notEmpty.wait_until(lock, deadline)) {
+                        if (static_cast<size_t>(totalThreadSize) > initialThreadSize) {
                             // 更新计数器
+                            sleepingThreadSize--;
+                            releaseWorkerSlot(slot);
+                            releaseThreadBudget();
+                            idleThreadSize--;
+                            totalThreadSize--;
+                            threadsRetired.fetch_add(1, std::memory_order_relaxed);
+                            // 线程不能join自己，交给下一次创建线程或者shutdown来join
+                            // 关闭过程中threads已经被shutdown取走，由它负责join
                             auto it = threads.find(threadId);
                             if (it != threads.end()) {
+                                exitedThreads.push_back(std::move(it->second));
                                 threads.erase(it);
-                                idleThreadSize--;
-                                totalThreadSize--;
-                                std::cout << "Thread " << threadId << " recycled due to idle timeout" << std::endl;
                             }
+                            POOL_LOG("Thread " << threadId << " recycled due to idle timeout");
                             return;
                         }
+                        // 线程数量已经不多于初始数量，重新开始计时
+                        lastTime = std::chrono::steady_clock::now();
                     }
                 } 
                 else {
                     // 固定模式，等待任务或线程池关闭
                     notEmpty.wait(lock, [this]() {
-                        return taskQueue.size() > 0 || !isPoolRunning;
+                        return hasPendingTask() || !isPoolRunning;
                     });
                 }
 
@@ -204,41 +1299,169 @@ void ThreadPool::threadFunc(int threadId) {
                 }
 
             }
+            sleepingThreadSize--;
+            if (timed) {
+                uint64_t idle = toNanos(std::chrono::steady_clock::now() - idleStart);
+                if (spinning) {
+                    spinBudget.update(idle);
+                }
+                if (metricsEnabled) {
+                    detail::WorkerStats::add(stats.idleNanos, idle);
+                }
+            }
 
-            // 再次检查队列是否为空（防止竞态条件）
-            if (taskQueue.empty()) {
+            // 工作窃取和无锁队列模式回到锁外重新取任务；共享队列模式再次检查队列是否为空（防止竞态条件）
+            if (!isLockedQueue() || lockedQueueSize() == 0) {
                 continue;
             }
  
-            idleThreadSize--;
-            task = std::move(taskQueue.front());
-            taskQueue.pop();
-            taskSize--;
-            if (taskQueue.size() > 0) {
-                notEmpty.notify_all();
+            // 一次加锁取出一批任务，数量不超过剩余任务平均分给每个线程的份额，避免饿死其他线程
+            // 优先级队列每次只取一个，保证后提交的紧急任务不会排在已取出的任务后面
+            size_t share = lockedQueueSize() / std::max(totalThreadSize.load(), 1);
+            size_t batch = QueueMode::QUEUE_PRIORITY == queueMode ? 1 : std::max<size_t>(1, std::min(share, dequeueBatchSize));
+            job = popLockedTask();
+            for (size_t i = 1; i < batch; i++) {
+                localJobs.emplace_back(popLockedTask());
+            }
+            taskSize -= batch;
+            if (lockedQueueSize() > 0) {
+                notEmpty.notify_one();
             }
             notFull.notify_all();
         }
 
-        if (task) {
-            task->execute();
+        checkWatermarks();
+        idleThreadSize--;
+        if (job) {
+            lastTime = runJob(job, stats);
         } else {
             std::cerr << "taskQueue is null." << std::endl;
         }
         idleThreadSize++;
-        lastTime = std::chrono::high_resolution_clock::now(); // 更新时间
     }
 
-    // 线程退出时更新计数器
-    auto it = threads.find(threadId);
-    if (it != threads.end()) {
-        threads.erase(it);
-        totalThreadSize--;
-        idleThreadSize--;
-        std::cout << "Thread " << threadId << " exiting." << std::endl;
+    // 线程退出时更新计数器，Thread对象留给shutdown来join
+    currentLocalJobs = nullptr;
+    std::lock_guard<std::mutex> lock(taskQueueMutex);
+    releaseWorkerSlot(slot);
+    releaseThreadBudget();
+    totalThreadSize--;
+    idleThreadSize--;
+    threadsRetired.fetch_add(1, std::memory_order_relaxed);
+    POOL_LOG("Thread " << threadId << " exiting.");
+}
+
+
+std::chrono::steady_clock::time_point ThreadPool::runJob(Job& job, detail::WorkerStats& stats) {
+    std::chrono::steady_clock::time_point endTime;
+    if (metricsEnabled) {
+        auto startTime = std::chrono::steady_clock::now();
+        stats.queueWait.record(toNanos(startTime - job.enqueueTime()));
+        job();
+        endTime = std::chrono::steady_clock::now();
+        stats.execution.record(toNanos(endTime - startTime));
+    } else {
+        job();
+        endTime = std::chrono::steady_clock::now();
+    }
+    detail::WorkerStats::add(stats.tasksExecuted, 1);
+    return endTime;
+}
+
+bool ThreadPool::runPendingTask(int slot) {
+    Job job;
+    std::deque<Job>* localJobs = currentLocalJobs;
+    if (localJobs && !localJobs->empty()) {
+        if (cancelPending) {
+            discardedTaskSize += localJobs->size();
+            localJobs->clear();
+            return false;
+        }
+        job = std::move(localJobs->front());
+        localJobs->pop_front();
+    } else if (QueueMode::QUEUE_WORK_STEALING == queueMode) {
+        // 本线程队列尾部通常就是刚刚提交、正在等待的子任务
+        job = popWorkerTask(slot);
+    } else if (QueueMode::QUEUE_LOCK_FREE == queueMode) {
+        job = popRingTask();
+    } else {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        if (lockedQueueSize() == 0) {
+            return false;
+        }
+        job = popLockedTask();
+        taskSize--;
+        notFull.notify_all();
+    }
+    if (!job) {
+        return false;
+    }
+    checkWatermarks();
+    runJob(job, *workerStats[slot]);
+    return true;
+}
+
+// 没有任务可以执行时阻塞在事件上（Linux上是futex），结果就绪时set()唤醒；
+// 同时登记到helpingEvents，之后有任务入队而没有睡眠的线程可以唤醒时，提交者通过interrupt()打断等待，不需要轮询
+// 嵌套执行的任务又在等待结果时会继续嵌套，超过MAX_HELP_DEPTH层后只阻塞等待，不再执行其他任务
+void ThreadPool::helpUntil(OneShotEvent& event, int slot) {
+    if (currentHelpDepth >= MAX_HELP_DEPTH) {
+        compensateBlockedWorker();
+        return;
+    }
+    detail::WorkerStats& stats = *workerStats[slot];
+    currentHelpDepth++;
+    while (!event.ready()) {
+        if (runPendingTask(slot)) {
+            detail::WorkerStats::add(stats.helpedTasks, 1);
+            continue;
+        }
+        // 先登记等待再检查队列：检查之后入队的任务一定会打断这次等待
+        event.prepareWait();
+        bool pending;
+        {
+            std::lock_guard<std::mutex> lock(taskQueueMutex);
+            helpingEvents.push_back(&event);
+            helpingThreadSize++;
+            pending = hasPendingTask();
+        }
+        if (!pending) {
+            event.waitPrepared();
+        }
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        helpingEvents.erase(std::find(helpingEvents.begin(), helpingEvents.end(), &event));
+        helpingThreadSize--;
     }
+    currentHelpDepth--;
 }
 
+// 本线程即将阻塞，不再执行任务：批量取出的任务放回共享队列，再增加一个线程代替本线程，
+// 否则所有线程都阻塞时排队的任务没有线程执行。增加的线程空闲超过threadIdleTimeout后退出
+void ThreadPool::compensateBlockedWorker() {
+    Thread* thread = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(taskQueueMutex);
+        std::deque<Job>* localJobs = currentLocalJobs;
+        if (localJobs && !localJobs->empty()) {
+            taskSize += localJobs->size();
+            for (Job& job : *localJobs) {
+                pushLockedTask(std::move(job), std::chrono::steady_clock::time_point());
+            }
+            localJobs->clear();
+        }
+        thread = addWorkerThread();
+    }
+    if (thread) {
+        thread->start();
+    }
+}
+
+void detail::helpWait(OneShotEvent& event) {
+    if (!event.ready() && currentPool && currentWorkerSlot >= 0) {
+        currentPool->helpUntil(event, currentWorkerSlot);
+    }
+    event.wait();
+}
 
 
 /*
@@ -246,16 +1469,28 @@ void ThreadPool::threadFunc(int threadId) {
 
 */
 
-int Thread::generateId = 0;
+std::atomic<int> Thread::generateId(0);
 
 Thread::Thread(ThreadFunc func) : threadfunc(func), threadId(generateId++) {}
 
-Thread::~Thread() {}
+Thread::~Thread() {
+    join();
+}
 
 // 启动线程
 void Thread::start() {
-    std::thread t(threadfunc, threadId);
-    t.detach(); // 分离线程，使其在后台运行
+    thread = std::thread(threadfunc, threadId);
+}
+
+// 线程池保证不会在线程自身上调用join
+void Thread::join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool Thread::isCurrentThread() const {
+    return thread.get_id() == std::this_thread::get_id();
 }
 
 int Thread::getThreadId() const {
@@ -266,15 +1501,35 @@ int Thread::getThreadId() const {
     这里是Task实现代码
 */
 
-Task::Task() {}
+Task::Task() : m_claimed(false), m_inlinable(false) {}
 
 void Task::setResultPtr(std::shared_ptr<Result> resultPtr) {
     m_resultPtr = resultPtr;
+    m_claimed.store(false, std::memory_order_relaxed); // 每次提交重新开始
+}
+
+bool Task::claim() {
+    return !m_claimed.exchange(true, std::memory_order_acq_rel);
+}
+
+void Task::cancel(TaskStatus status) {
+    if (!claim()) {
+        return;
+    }
+    std::shared_ptr<Result> result = m_resultPtr;
+    if (result) {
+        result->setCancelled(status);
+    }
 }
 
 void Task::execute() {
-    if (m_resultPtr) {
-        m_resultPtr->setValue(run());
+    if (!claim()) {
+        return; // 已经由等待结果的工作线程执行过
+    }
+    // 持有一份引用：setValue唤醒等待者之后还要执行continuation，此时Result可能已经被用户释放
+    std::shared_ptr<Result> result = m_resultPtr;
+    if (result) {
+        result->setValue(run());
     }
 }
 
@@ -285,18 +1540,182 @@ void Task::execute() {
 
 */
 
-Result::Result(std::shared_ptr<Task> task, bool isValid) : m_task(task), m_isValid(isValid) {
+Result::Result(std::shared_ptr<Task> task, bool isValid)
+    : m_status(TaskStatus::STATUS_PENDING), m_task(task), m_isValid(isValid) {
     // 不再setResult
 }
 
 void Result::setValue(Any any) {
+    complete(std::move(any), TaskStatus::STATUS_COMPLETED);
+}
+
+void Result::setCancelled(TaskStatus status) {
+    complete(Any(), status);
+}
+
+void Result::complete(Any any, TaskStatus status) {
     // 存储task的返回值
     m_any = std::move(any);
-    m_semaphore.post(); // 任务执行完成，通知等待的线程
+    m_status.store(status, std::memory_order_release);
+    m_event.set(); // 任务执行完成，只有存在等待的线程时才会唤醒
+    m_continuations.close(); // 把注册的continuation投递到线程池
 }
 
 Any Result::get() {
     if (!m_isValid) return "";
-    m_semaphore.wait(); // 等待任务执行完成
+    if (!m_event.ready() && currentPool && currentWorkerSlot >= 0) {
+        // 在工作线程上等待的任务还没有开始时直接在本线程执行，不依赖其他线程取到它
+        // 带有取消令牌或者过期时间的任务要在出队时检查，仍然留给队列执行
+        std::shared_ptr<Task> task = m_task.lock();
+        if (task && task->m_inlinable) {
+            task->execute();
+        }
+    }
+    detail::helpWait(m_event); // 等待任务执行完成，在工作线程上等待期间执行其他排队的任务
     return std::move(m_any);
 }
+
+bool Result::ready() const {
+    return !m_isValid || m_event.ready();
+}
+
+TaskStatus Result::status() const {
+    if (!m_isValid) {
+        return TaskStatus::STATUS_CANCELLED;
+    }
+    return m_status.load(std::memory_order_acquire);
+}
+
+/*
+    这里是取消令牌实现代码
+*/
+
+CancellationSource::CancellationSource()
+    : m_state(std::allocate_shared<detail::CancelState>(detail::PoolAllocator<detail::CancelState>())) {}
+
+const CancellationToken& CancellationToken::current() {
+    static const CancellationToken never;
+    return currentToken ? *currentToken : never;
+}
+
+const CancellationToken* detail::exchangeCurrentToken(const CancellationToken* token) {
+    const CancellationToken* previous = currentToken;
+    currentToken = token;
+    return previous;
+}
+
+/*
+    这里是OneShotEvent实现代码
+*/
+
+#ifdef __linux__
+namespace {
+// timeout为nullptr时一直等待
+long futexWait(std::atomic<uint32_t>* addr, uint32_t expected, const struct timespec* timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t>* addr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+}
+
+void OneShotEvent::set() {
+    if (m_state.exchange(STATE_READY, std::memory_order_acq_rel) == STATE_WAITING) {
+        futexWakeAll(&m_state);
+    }
+}
+
+void OneShotEvent::wait() {
+    uint32_t state = m_state.load(std::memory_order_acquire);
+    while (state != STATE_READY) {
+        // 先登记有线程在等待，set()看到这个标记才会发起唤醒
+        if (state == STATE_EMPTY && !m_state.compare_exchange_weak(state, STATE_WAITING, std::memory_order_acq_rel)) {
+            continue;
+        }
+        futexWait(&m_state, STATE_WAITING, nullptr);
+        state = m_state.load(std::memory_order_acquire);
+    }
+}
+
+bool OneShotEvent::waitUntilSteady(std::chrono::steady_clock::time_point deadline) {
+    uint32_t state = m_state.load(std::memory_order_acquire);
+    while (state != STATE_READY) {
+        if (state == STATE_EMPTY && !m_state.compare_exchange_weak(state, STATE_WAITING, std::memory_order_acq_rel)) {
+            continue;
+        }
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero()) {
+            return false;
+        }
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+        struct timespec timeout;
+        timeout.tv_sec = static_cast<time_t>(seconds.count());
+        timeout.tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds).count());
+        futexWait(&m_state, STATE_WAITING, &timeout);
+        state = m_state.load(std::memory_order_acquire);
+    }
+    return true;
+}
+
+void OneShotEvent::prepareWait() {
+    uint32_t expected = STATE_EMPTY;
+    m_state.compare_exchange_strong(expected, STATE_WAITING, std::memory_order_acq_rel);
+}
+
+// 登记之后的interrupt()把状态改回STATE_EMPTY，这里的futexWait发现值已经改变会立即返回
+void OneShotEvent::waitPrepared() {
+    futexWait(&m_state, STATE_WAITING, nullptr);
+}
+
+// 其他等待的线程醒来后看到STATE_EMPTY会重新登记，set()仍然能唤醒它们
+void OneShotEvent::interrupt() {
+    uint32_t expected = STATE_WAITING;
+    if (m_state.compare_exchange_strong(expected, STATE_EMPTY, std::memory_order_acq_rel)) {
+        futexWakeAll(&m_state);
+    }
+}
+#else
+void OneShotEvent::set() {
+    if (m_state.exchange(STATE_READY, std::memory_order_acq_rel) == STATE_WAITING) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cv.notify_all();
+    }
+}
+
+// 被interrupt()唤醒时状态已经改回STATE_EMPTY，每次检查时重新登记
+void OneShotEvent::wait() {
+    if (ready()) return;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() {
+        prepareWait();
+        return ready();
+    });
+}
+
+bool OneShotEvent::waitUntilSteady(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_cv.wait_until(lock, deadline, [this]() {
+        prepareWait();
+        return ready();
+    });
+}
+
+void OneShotEvent::prepareWait() {
+    uint32_t expected = STATE_EMPTY;
+    m_state.compare_exchange_strong(expected, STATE_WAITING, std::memory_order_acq_rel);
+}
+
+void OneShotEvent::waitPrepared() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return m_state.load(std::memory_order_acquire) != STATE_WAITING; });
+}
+
+void OneShotEvent::interrupt() {
+    uint32_t expected = STATE_WAITING;
+    if (m_state.compare_exchange_strong(expected, STATE_EMPTY, std::memory_order_acq_rel)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cv.notify_all();
+    }
+}
+#endif
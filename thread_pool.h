@@ -2,7 +2,9 @@
 #define __THREAD_POOL_H
 
 #include <vector>
+#include <algorithm>
 #include <queue>
+#include <deque>
 #include <memory>
 #include <atomic>
 #include <mutex>
@@ -12,58 +14,161 @@
 #include <unordered_map>
 #include <thread>
 #include <typeinfo>
+#include <tuple>
+#include <type_traits>
+#include <exception>
+#include <future>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <stdexcept>
+#include "mpmc_queue.h"
+#include "cpu_topology.h"
+#include "pool_metrics.h"
+#include "block_pool.h"
 
 // Any 类型：可以接受任意数据的类型
+// 小的、移动不会抛异常的值直接存放在内部缓冲区，其余的放在内存池中；
+// 类型检查比较每个类型唯一的静态地址，不依赖RTTI，可以在 -fno-rtti 下使用
 class Any {
 public:
-    Any() = default;
-    ~Any() = default;
+    static const size_t INLINE_SIZE = 32;
+
+    Any() noexcept : m_ops(nullptr) {}
+    ~Any() {
+        reset();
+    }
 
     // 禁止拷贝构造和赋值
     Any(const Any&) = delete;
     Any &operator = (const Any&) = delete;
 
-    Any(Any&&) = default;
-    Any &operator = (Any&&) = default;
+    Any(Any&& other) noexcept : m_ops(other.m_ops) {
+        if (m_ops) {
+            m_ops->move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    Any &operator = (Any&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_ops = other.m_ops;
+            if (m_ops) {
+                m_ops->move(&m_storage, &other.m_storage);
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    // 模板构造函数，接受任意类型的参数，右值直接移动进来
+    template<typename T, typename = typename std::enable_if<!std::is_same<typename std::decay<T>::type, Any>::value>::type>
+    Any(T&& data) : m_ops(nullptr) {
+        using U = typename std::decay<T>::type;
+        construct<U>(std::forward<T>(data), std::integral_constant<bool, isInline<U>()>());
+    }
 
-    // 模板构造函数，接受任意类型的参数
+    // 获取存储值的拷贝
     template<typename T>
-    Any(T data) : m_base(std::make_unique<Derived<T>>(data)) {}
+    T cast() const & {
+        return *checkedGet<T>();
+    }
 
-    // 获取存储的值
+    // 从临时的Any（例如 result->get().cast<T>()）中把值移动出来
     template<typename T>
-    T cast() {
-        // 基类指针转换成派生类指针，使用 dynamic_cast 进行类型转换
-        Derived<T>* ans = dynamic_cast<Derived<T>*>(m_base.get());
-        if (!ans) {
-            throw std::bad_cast();
-        }
-        return ans->get();
+    T cast() && {
+        return std::move(*checkedGet<T>());
+    }
+
+    bool hasValue() const noexcept {
+        return m_ops != nullptr;
     }
 
 private:
-    // 基类，所有类型都继承自这个基类
-    class Base {
-    public:
-        virtual ~Base() = default;
-    }; 
+    // 每个类型对应一个静态变量，用它的地址作为类型标识
+    template<typename T>
+    struct TypeId {
+        static char id;
+    };
+
+    struct Ops {
+        const void* typeId;
+        void* (*get)(void* storage);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template<typename T>
+    static constexpr bool isInline() {
+        return sizeof(T) <= INLINE_SIZE && alignof(T) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<T>::value;
+    }
 
-    // 派生类
-    template<typename T> 
-    class Derived : public Base { 
-    public:
-        Derived(T data) : m_data(data) {}
-        ~Derived() = default;
-        T get() const {
-            return m_data;
+    // 值直接存放在内部缓冲区
+    template<typename T>
+    struct InlineOps {
+        static void* get(void* storage) { return storage; }
+        static void move(void* dst, void* src) {
+            new (dst) T(std::move(*static_cast<T*>(src)));
+            static_cast<T*>(src)->~T();
         }
-    private:
-        T m_data;
+        static void destroy(void* storage) { static_cast<T*>(storage)->~T(); }
+        static const Ops ops;
+    };
+
+    // 值放在内存池中，内部缓冲区只存放指针
+    template<typename T>
+    struct HeapOps {
+        static void* get(void* storage) { return *static_cast<T**>(storage); }
+        static void move(void* dst, void* src) { *static_cast<T**>(dst) = *static_cast<T**>(src); }
+        static void destroy(void* storage) { detail::poolDelete(*static_cast<T**>(storage)); }
+        static const Ops ops;
     };
+
+    template<typename U, typename T>
+    void construct(T&& data, std::true_type) {
+        new (&m_storage) U(std::forward<T>(data));
+        m_ops = &InlineOps<U>::ops;
+    }
+
+    template<typename U, typename T>
+    void construct(T&& data, std::false_type) {
+        *reinterpret_cast<U**>(&m_storage) = detail::poolNew<U>(std::forward<T>(data));
+        m_ops = &HeapOps<U>::ops;
+    }
+
+    // 类型不匹配时抛出 std::bad_cast
+    template<typename T>
+    T* checkedGet() const {
+        if (!m_ops || m_ops->typeId != &TypeId<T>::id) {
+            throw std::bad_cast();
+        }
+        return static_cast<T*>(m_ops->get(const_cast<void*>(static_cast<const void*>(&m_storage))));
+    }
+
+    void reset() noexcept {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
 private:
-    std::unique_ptr<Base> m_base;
+    const Ops* m_ops;
+    alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
 };
 
+template<typename T>
+char Any::TypeId<T>::id = 0;
+
+template<typename T>
+const Any::Ops Any::InlineOps<T>::ops = { &TypeId<T>::id, &InlineOps<T>::get, &InlineOps<T>::move, &InlineOps<T>::destroy };
+
+template<typename T>
+const Any::Ops Any::HeapOps<T>::ops = { &TypeId<T>::id, &HeapOps<T>::get, &HeapOps<T>::move, &HeapOps<T>::destroy };
+
 // 这里实现一个信号量类
 class Semaphore {
 public:
@@ -92,23 +197,880 @@ private:
     std::condition_variable cv;
 };
 
+// 一次性完成事件：set()只调用一次，之后所有的wait()都立即返回
+// 状态保存在一个原子变量中，已完成时的检查不需要加锁；
+// 只有确实有线程阻塞等待时，set()才需要唤醒（Linux下使用futex，其他平台退化为条件变量）
+class OneShotEvent {
+public:
+    OneShotEvent() : m_state(STATE_EMPTY) {}
+    ~OneShotEvent() = default;
+
+    OneShotEvent(const OneShotEvent&) = delete;
+    OneShotEvent &operator = (const OneShotEvent&) = delete;
+
+    // 标记完成并唤醒等待的线程
+    void set();
+
+    // 是否已经完成，不会阻塞
+    bool ready() const {
+        return m_state.load(std::memory_order_acquire) == STATE_READY;
+    }
+
+    // 阻塞直到完成
+    void wait();
+
+    // 最多等待一段时间，返回是否已经完成
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout) {
+        if (ready()) return true;
+        return waitUntilSteady(std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+    }
+
+    // 最多等待到某个时间点，返回是否已经完成
+    template<typename Clock, typename Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+        if (ready()) return true;
+        return waitFor(deadline - Clock::now());
+    }
+
+private:
+    friend class ThreadPool;
+
+    bool waitUntilSteady(std::chrono::steady_clock::time_point deadline);
+
+    // 以下三个函数供线程池中等待结果的工作线程使用：有新任务入队时由提交者打断等待
+    // 先登记等待，之后检查任务队列，再调用waitPrepared()；这期间的interrupt()会让waitPrepared()立即返回
+    void prepareWait();
+    // 最多阻塞一次，可能因为interrupt()在完成之前返回
+    void waitPrepared();
+    // 唤醒所有等待的线程但不标记完成，它们重新登记后继续等待
+    void interrupt();
+
+    enum : uint32_t {
+        STATE_EMPTY = 0,   // 未完成，没有线程在等待
+        STATE_WAITING = 1, // 未完成，有线程在等待
+        STATE_READY = 2    // 已完成
+    };
+
+    std::atomic<uint32_t> m_state;
+#ifndef __linux__
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+#endif
+};
+
+namespace detail {
+// 等待event完成；在工作线程上调用时，等待期间执行排队的任务，而不是阻塞线程
+// 任务内部等待子任务的结果时，Fixed模式不会因为所有线程都在等待而死锁，Cached模式也不需要为此创建新线程
+void helpWait(OneShotEvent& event);
+} // namespace detail
+
+// 任务的完成状态
+enum class TaskStatus {
+    STATUS_PENDING,   // 还没有完成
+    STATUS_COMPLETED, // 执行完成（包括抛出异常）
+    STATUS_CANCELLED, // 没有执行：令牌被取消、关闭线程池时被丢弃或者提交失败
+    STATUS_EXPIRED    // 没有执行：开始执行之前已经超过截止时间
+};
+
+// 任务因为取消或者过期没有执行时，TaskFuture::get()抛出的异常
+class TaskCancelledError : public std::runtime_error {
+public:
+    explicit TaskCancelledError(TaskStatus status)
+        : std::runtime_error(TaskStatus::STATUS_EXPIRED == status ? "task expired" : "task cancelled"), m_status(status) {}
+
+    // STATUS_CANCELLED或STATUS_EXPIRED
+    TaskStatus status() const noexcept {
+        return m_status;
+    }
+
+private:
+    TaskStatus m_status;
+};
+
+namespace detail {
+struct CancelState {
+    std::atomic<bool> cancelled{false};
+};
+}
+
+// 取消令牌，提交任务时通过TaskOptions传入
+// 令牌被取消或者超过截止时间后，还在排队的任务出队时直接跳过；正在执行的任务通过cancelled()轮询，自行提前结束
+// 只是一个指针加一个时间点，可以随意拷贝
+class CancellationToken {
+public:
+    // 默认构造的令牌永远不会被取消
+    CancellationToken() : m_deadline(std::chrono::steady_clock::time_point::max()) {}
+
+    bool cancelled() const {
+        return TaskStatus::STATUS_PENDING != status();
+    }
+
+    // 被取消时返回STATUS_CANCELLED，超过截止时间时返回STATUS_EXPIRED，否则返回STATUS_PENDING
+    // 只有设置了截止时间时才读取时钟
+    TaskStatus status() const {
+        if (m_state && m_state->cancelled.load(std::memory_order_acquire)) {
+            return TaskStatus::STATUS_CANCELLED;
+        }
+        if (m_deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= m_deadline) {
+            return TaskStatus::STATUS_EXPIRED;
+        }
+        return TaskStatus::STATUS_PENDING;
+    }
+
+    // 是否可能被取消（关联了CancellationSource或者设置了截止时间）
+    bool cancellable() const {
+        return m_state || m_deadline != std::chrono::steady_clock::time_point::max();
+    }
+
+    // 返回加上截止时间的令牌，已经有截止时间时取较早的一个
+    CancellationToken withDeadline(std::chrono::steady_clock::time_point deadline) const {
+        CancellationToken token(*this);
+        token.m_deadline = std::min(m_deadline, deadline);
+        return token;
+    }
+    template<typename Rep, typename Period>
+    CancellationToken withTimeout(const std::chrono::duration<Rep, Period>& timeout) const {
+        return withDeadline(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+    }
+
+    // 当前线程正在执行的任务的令牌，不在带令牌的任务中时返回永远不会被取消的令牌
+    // 任务内部不需要捕获令牌就可以轮询：CancellationToken::current().cancelled()
+    static const CancellationToken& current();
+
+private:
+    friend class CancellationSource;
+
+    std::shared_ptr<detail::CancelState> m_state;
+    std::chrono::steady_clock::time_point m_deadline;
+};
+
+// 取消令牌的来源，cancel()之后它发出的所有令牌都被取消
+class CancellationSource {
+public:
+    CancellationSource();
+
+    // 可以重复调用，可以在任何线程上调用
+    void cancel() {
+        m_state->cancelled.store(true, std::memory_order_release);
+    }
+    bool cancelled() const {
+        return m_state->cancelled.load(std::memory_order_acquire);
+    }
+    CancellationToken token() const {
+        CancellationToken token;
+        token.m_state = m_state;
+        return token;
+    }
+
+private:
+    std::shared_ptr<detail::CancelState> m_state;
+};
+
+namespace detail {
+// 切换当前线程正在执行的任务的令牌，返回之前的令牌，用于嵌套执行时恢复
+const CancellationToken* exchangeCurrentToken(const CancellationToken* token);
+}
+
+// 任务队列中的元素：类型擦除、只能移动的可调用对象
+// 不超过INLINE_SIZE字节的可调用对象直接构造在内部缓冲区里，不需要堆分配，也没有虚函数
+class Job {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    Job() noexcept : m_ops(nullptr) {}
+    ~Job() {
+        reset();
+    }
+
+    template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Job>::value>::type>
+    Job(F&& func) : m_ops(nullptr) {
+        using Fn = typename std::decay<F>::type;
+        construct<Fn>(std::forward<F>(func), std::integral_constant<bool, isInline<Fn>()>());
+    }
+
+    // 禁止拷贝构造和赋值
+    Job(const Job&) = delete;
+    Job &operator = (const Job&) = delete;
+
+    Job(Job&& other) noexcept : m_ops(other.m_ops), m_enqueueTime(other.m_enqueueTime) {
+        if (m_ops) {
+            m_ops->move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    Job &operator = (Job&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_ops = other.m_ops;
+            m_enqueueTime = other.m_enqueueTime;
+            if (m_ops) {
+                m_ops->move(&m_storage, &other.m_storage);
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    explicit operator bool() const noexcept {
+        return m_ops != nullptr;
+    }
+
+    void operator()() {
+        m_ops->invoke(&m_storage);
+    }
+
+    // 任务进入队列的时间，用于统计排队时间
+    void setEnqueueTime(std::chrono::steady_clock::time_point time) noexcept {
+        m_enqueueTime = time;
+    }
+    std::chrono::steady_clock::time_point enqueueTime() const noexcept {
+        return m_enqueueTime;
+    }
+
+private:
+    // 每种可调用类型对应一张静态的函数表，代替虚函数
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template<typename Fn>
+    static constexpr bool isInline() {
+        return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    // 可调用对象直接存放在内部缓冲区
+    template<typename Fn>
+    struct InlineOps {
+        static void invoke(void* storage) { (*static_cast<Fn*>(storage))(); }
+        static void move(void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+        static void destroy(void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+        static const Ops ops;
+    };
+
+    // 可调用对象太大，内部缓冲区只存放指向内存池中对象的指针
+    template<typename Fn>
+    struct HeapOps {
+        static void invoke(void* storage) { (**static_cast<Fn**>(storage))(); }
+        static void move(void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); }
+        static void destroy(void* storage) { detail::poolDelete(*static_cast<Fn**>(storage)); }
+        static const Ops ops;
+    };
+
+    template<typename Fn, typename F>
+    void construct(F&& func, std::true_type) {
+        new (&m_storage) Fn(std::forward<F>(func));
+        m_ops = &InlineOps<Fn>::ops;
+    }
+
+    template<typename Fn, typename F>
+    void construct(F&& func, std::false_type) {
+        *reinterpret_cast<Fn**>(&m_storage) = detail::poolNew<Fn>(std::forward<F>(func));
+        m_ops = &HeapOps<Fn>::ops;
+    }
+
+    void reset() noexcept {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    const Ops* m_ops;
+    std::chrono::steady_clock::time_point m_enqueueTime; // 放在m_storage对齐留下的空隙中，不增加Job的大小
+    alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
+};
+
+template<typename Fn>
+const Job::Ops Job::InlineOps<Fn>::ops = { &InlineOps<Fn>::invoke, &InlineOps<Fn>::move, &InlineOps<Fn>::destroy };
+
+template<typename Fn>
+const Job::Ops Job::HeapOps<Fn>::ops = { &HeapOps<Fn>::invoke, &HeapOps<Fn>::move, &HeapOps<Fn>::destroy };
+
+namespace detail {
+
+// 可调用对象以参数调用后的返回值类型
+// std::result_of在C++20中已经移除（MSVC和libc++不再提供），C++17起使用std::invoke_result
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+template<typename F, typename... Args>
+using InvokeResult = typename std::decay<std::invoke_result_t<typename std::decay<F>::type, typename std::decay<Args>::type...>>::type;
+#else
+template<typename F, typename... Args>
+using InvokeResult = typename std::decay<typename std::result_of<typename std::decay<F>::type(typename std::decay<Args>::type...)>::type>::type;
+#endif
+
+// 保存任务返回值的存储区，void类型不需要存储
+template<typename R>
+class FutureValue {
+public:
+    ~FutureValue() {
+        if (m_hasValue) {
+            reinterpret_cast<R*>(&m_storage)->~R();
+        }
+    }
+    template<typename V>
+    void set(V&& value) {
+        new (&m_storage) R(std::forward<V>(value));
+        m_hasValue = true;
+    }
+    R take() {
+        return std::move(*reinterpret_cast<R*>(&m_storage));
+    }
+private:
+    typename std::aligned_storage<sizeof(R), alignof(R)>::type m_storage;
+    bool m_hasValue = false;
+};
+
+template<>
+class FutureValue<void> {
+public:
+    void take() {}
+};
+
+// 任务完成后要执行的回调列表
+// 回调以无锁单链表的形式挂在头指针上，完成时把头指针换成哨兵，之后的注册都会失败
+class ContinuationList {
+public:
+    ContinuationList() : m_head(nullptr) {}
+    // 任务一直没有完成时，未执行的回调随之销毁
+    ~ContinuationList() {
+        Node* node = m_head.load(std::memory_order_acquire);
+        if (node != closed()) {
+            destroy(node);
+        }
+    }
+
+    ContinuationList(const ContinuationList&) = delete;
+    ContinuationList &operator = (const ContinuationList&) = delete;
+
+    // 注册回调；已经完成时返回false，job保持原样，由调用者自己执行
+    bool add(Job& job) {
+        Node* node = new Node{ std::move(job), m_head.load(std::memory_order_acquire) };
+        while (node->next != closed()) {
+            if (m_head.compare_exchange_weak(node->next, node, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        job = std::move(node->job);
+        delete node;
+        return false;
+    }
+
+    // 标记完成，并按注册顺序执行所有回调
+    void close() {
+        Node* node = m_head.exchange(closed(), std::memory_order_acq_rel);
+        // 链表是后进先出的，先反转
+        Node* ordered = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+        while (ordered) {
+            Node* next = ordered->next;
+            ordered->job();
+            delete ordered;
+            ordered = next;
+        }
+    }
+
+private:
+    struct Node {
+        Job job;
+        Node* next;
+
+        static void* operator new(size_t size) { return BlockPool::allocate(size); }
+        static void operator delete(void* node, size_t size) noexcept { BlockPool::deallocate(node, size); }
+    };
+    static_assert(IsPoolable<Node>::value, "continuation nodes must fit the block pool alignment");
+
+    static Node* closed() {
+        static Node sentinel;
+        return &sentinel;
+    }
+
+    static void destroy(Node* node) {
+        while (node) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    std::atomic<Node*> m_head;
+};
+
+// submit提交的任务与TaskFuture之间共享的状态
+// 引用计数是侵入式的，整个状态只需要从内存池分配一次；完成通知使用OneShotEvent
+template<typename R>
+class FutureState {
+public:
+    FutureState() : m_refCount(1), m_status(TaskStatus::STATUS_PENDING) {}
+
+    // 返回值类型的对齐要求超过max_align_t时不能放进内存块，和poolNew一样交给全局分配器
+    static void* operator new(size_t size) {
+        return IsPoolable<FutureState>::value ? BlockPool::allocate(size) : ::operator new(size);
+    }
+    static void operator delete(void* state, size_t size) noexcept {
+        if (IsPoolable<FutureState>::value) {
+            BlockPool::deallocate(state, size);
+        } else {
+            ::operator delete(state);
+        }
+    }
+#ifdef __cpp_aligned_new
+    // C++17起过度对齐的类型使用带对齐参数的版本
+    static void* operator new(size_t size, std::align_val_t align) {
+        return ::operator new(size, align);
+    }
+    static void operator delete(void* state, std::align_val_t align) noexcept {
+        ::operator delete(state, align);
+    }
+#endif
+
+    void addRef() {
+        m_refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    template<typename V>
+    void setValue(V&& value) {
+        m_value.set(std::forward<V>(value));
+        complete();
+    }
+
+    void setValue() {
+        complete();
+    }
+
+    void setException(std::exception_ptr exception, TaskStatus status = TaskStatus::STATUS_COMPLETED) {
+        m_exception = exception;
+        complete(status);
+    }
+
+    // 任务没有执行，get()抛出TaskCancelledError
+    void cancel(TaskStatus status) {
+        setException(std::make_exception_ptr(TaskCancelledError(status)), status);
+    }
+
+    OneShotEvent& event() {
+        return m_event;
+    }
+
+    TaskStatus status() const {
+        return m_status.load(std::memory_order_acquire);
+    }
+
+    // 注册完成回调；已经完成时返回false，由调用者自己执行
+    bool addContinuation(Job& job) {
+        return m_continuations.add(job);
+    }
+
+    R get() {
+        helpWait(m_event);
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+        return m_value.take();
+    }
+
+private:
+    void complete(TaskStatus status = TaskStatus::STATUS_COMPLETED) {
+        m_status.store(status, std::memory_order_release);
+        m_event.set();
+        m_continuations.close();
+    }
+
+private:
+    std::atomic<int> m_refCount;
+    std::atomic<TaskStatus> m_status;
+    OneShotEvent m_event;
+    ContinuationList m_continuations;
+    FutureValue<R> m_value;
+    std::exception_ptr m_exception;
+};
+
+// 任务一侧持有的状态引用，负责写入返回值或异常
+// 任务没有执行就被销毁时（例如提交失败），等待方会得到broken_promise异常
+template<typename R>
+class TaskPromise {
+public:
+    explicit TaskPromise(FutureState<R>* state) : m_state(state) {
+        m_state->addRef();
+    }
+
+    ~TaskPromise() {
+        if (m_state) {
+            if (!m_state->event().ready()) {
+                m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)),
+                                      TaskStatus::STATUS_CANCELLED);
+            }
+            m_state->release();
+        }
+    }
+
+    TaskPromise(const TaskPromise&) = delete;
+    TaskPromise &operator = (const TaskPromise&) = delete;
+
+    TaskPromise(TaskPromise&& other) noexcept : m_state(other.m_state) {
+        other.m_state = nullptr;
+    }
+
+    // 直接写入结果，用于不经过run()执行的任务（例如协程）
+    template<typename... V>
+    void setValue(V&&... value) {
+        m_state->setValue(std::forward<V>(value)...);
+    }
+
+    void setException(std::exception_ptr exception) {
+        m_state->setException(exception);
+    }
+
+    // 任务被取消或者过期，不再执行
+    void cancel(TaskStatus status) {
+        m_state->cancel(status);
+    }
+
+    template<typename F, typename Tuple, size_t... I>
+    void run(F& func, Tuple& args, std::index_sequence<I...>) {
+        try {
+            invoke(std::is_void<R>(), func, std::get<I>(std::move(args))...);
+        } catch (...) {
+            m_state->setException(std::current_exception());
+        }
+    }
+
+private:
+    template<typename F, typename... Args>
+    void invoke(std::true_type, F& func, Args&&... args) {
+        func(std::forward<Args>(args)...);
+        m_state->setValue();
+    }
+
+    template<typename F, typename... Args>
+    void invoke(std::false_type, F& func, Args&&... args) {
+        m_state->setValue(func(std::forward<Args>(args)...));
+    }
+
+private:
+    FutureState<R>* m_state;
+};
+
+// continuation接收上游的返回值，上游返回void时不带参数
+template<typename F, typename R>
+struct ContinuationResultImpl {
+    using type = InvokeResult<F, R>;
+};
+
+template<typename F>
+struct ContinuationResultImpl<F, void> {
+    using type = InvokeResult<F>;
+};
+
+template<typename F, typename R>
+using ContinuationResult = typename ContinuationResultImpl<F, R>::type;
+
+// 上游是TaskFuture时持有它的共享状态，取出返回值后调用continuation
+template<typename R>
+class FutureRef {
+public:
+    explicit FutureRef(FutureState<R>* state) noexcept : m_state(state) {}
+    ~FutureRef() {
+        if (m_state) {
+            m_state->release();
+        }
+    }
+    FutureRef(FutureRef&& other) noexcept : m_state(other.m_state) {
+        other.m_state = nullptr;
+    }
+
+    // 上游抛出的异常在get()中重新抛出，直接传递给下游
+    template<typename F>
+    decltype(auto) apply(F& func) {
+        return apply(func, std::is_void<R>());
+    }
+
+private:
+    template<typename F>
+    decltype(auto) apply(F& func, std::false_type) {
+        return func(m_state->get());
+    }
+
+    template<typename F>
+    decltype(auto) apply(F& func, std::true_type) {
+        m_state->get();
+        return func();
+    }
+
+    FutureState<R>* m_state;
+};
+
+// 上游完成后投递到线程池执行的continuation，结果写入下游的共享状态
+template<typename R, typename Upstream, typename F>
+class ContinuationInvoker {
+public:
+    template<typename Fn>
+    ContinuationInvoker(Upstream upstream, FutureState<R>* state, Fn&& func)
+        : m_upstream(std::move(upstream)), m_promise(state), m_func(std::forward<Fn>(func)) {}
+
+    ContinuationInvoker(ContinuationInvoker&&) = default;
+
+    void operator()() {
+        auto call = [this]() -> R { return m_upstream.apply(m_func); };
+        std::tuple<> args;
+        m_promise.run(call, args, std::index_sequence<>());
+    }
+
+private:
+    Upstream m_upstream;
+    TaskPromise<R> m_promise;
+    F m_func;
+};
+
+// 放入Job中的任务：可调用对象、参数和TaskPromise打包在一起
+template<typename R, typename F, typename... Args>
+class TaskInvoker {
+public:
+    template<typename Fn, typename... As>
+    TaskInvoker(FutureState<R>* state, Fn&& func, As&&... args)
+        : m_promise(state), m_func(std::forward<Fn>(func)), m_args(std::forward<As>(args)...) {}
+
+    void operator()() {
+        m_promise.run(m_func, m_args, std::index_sequence_for<Args...>());
+    }
+
+    void cancel(TaskStatus status) {
+        m_promise.cancel(status);
+    }
+
+private:
+    TaskPromise<R> m_promise;
+    F m_func;
+    std::tuple<Args...> m_args;
+};
+
+// 因为取消或者过期而跳过的任务数量
+struct SkippedTasks {
+    std::atomic<uint64_t> cancelled{0};
+    std::atomic<uint64_t> expired{0};
+};
+
+// 跳过任务时通知等待方：任务带有cancel(TaskStatus)时调用它，post提交的任务直接销毁
+template<typename Inner>
+auto cancelInner(Inner& inner, TaskStatus status, int) -> decltype(inner.cancel(status), void()) {
+    inner.cancel(status);
+}
+
+template<typename Inner>
+void cancelInner(Inner&, TaskStatus, long) {}
+
+// 带取消令牌的任务：出队执行前先检查令牌，已经取消或过期时不执行，只把原因告诉等待方
+// 执行期间把令牌登记为当前线程的令牌，任务内部可以通过CancellationToken::current()轮询
+template<typename Inner>
+class CancellableJob {
+public:
+    CancellableJob(Inner inner, CancellationToken token, SkippedTasks* skipped)
+        : m_inner(std::move(inner)), m_token(std::move(token)), m_skipped(skipped) {}
+
+    CancellableJob(CancellableJob&&) = default;
+
+    void operator()() {
+        TaskStatus status = m_token.status();
+        if (TaskStatus::STATUS_PENDING != status) {
+            auto& counter = TaskStatus::STATUS_EXPIRED == status ? m_skipped->expired : m_skipped->cancelled;
+            counter.fetch_add(1, std::memory_order_relaxed);
+            cancelInner(m_inner, status, 0);
+            return;
+        }
+        struct Scope {
+            const CancellationToken* previous;
+            ~Scope() { exchangeCurrentToken(previous); }
+        } scope{ exchangeCurrentToken(&m_token) };
+        m_inner();
+    }
+
+private:
+    Inner m_inner;
+    CancellationToken m_token;
+    SkippedTasks* m_skipped;
+};
+
+} // namespace detail
+
+// 前向声明
+class ThreadPool;
+class ScheduleAwaiter;
+
+// submit返回的轻量级future，get()只能调用一次
+// 可调用对象返回引用时，结果按值保存
+template<typename R>
+class TaskFuture {
+public:
+    TaskFuture() noexcept : m_state(nullptr) {}
+    // 接管state的一个引用
+    explicit TaskFuture(detail::FutureState<R>* state) noexcept : m_state(state) {}
+    ~TaskFuture() {
+        if (m_state) {
+            m_state->release();
+        }
+    }
+
+    // 禁止拷贝构造和赋值
+    TaskFuture(const TaskFuture&) = delete;
+    TaskFuture &operator = (const TaskFuture&) = delete;
+
+    TaskFuture(TaskFuture&& other) noexcept : m_state(other.m_state) {
+        other.m_state = nullptr;
+    }
+
+    TaskFuture &operator = (TaskFuture&& other) noexcept {
+        if (this != &other) {
+            if (m_state) {
+                m_state->release();
+            }
+            m_state = other.m_state;
+            other.m_state = nullptr;
+        }
+        return *this;
+    }
+
+    // 是否关联了一个任务（get()之后不再关联）
+    bool valid() const {
+        return m_state != nullptr;
+    }
+
+    // 任务是否已经执行完成，不会阻塞；无效的TaskFuture（例如trySubmit失败时返回的）视为已经完成
+    bool ready() const {
+        return !m_state || m_state->event().ready();
+    }
+
+    // 任务的完成状态，取消或者过期的任务get()抛出TaskCancelledError；无效的TaskFuture返回STATUS_CANCELLED
+    TaskStatus status() const {
+        return m_state ? m_state->status() : TaskStatus::STATUS_CANCELLED;
+    }
+
+    // 等待任务执行完成，在工作线程上等待期间执行其他排队的任务
+    void wait() const {
+        if (m_state) {
+            detail::helpWait(m_state->event());
+        }
+    }
+
+    // 最多等待一段时间，返回任务是否已经执行完成
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout) const {
+        return !m_state || m_state->event().waitFor(timeout);
+    }
+
+    // 最多等待到某个时间点，返回任务是否已经执行完成
+    template<typename Clock, typename Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration>& deadline) const {
+        return !m_state || m_state->event().waitUntil(deadline);
+    }
+
+    // 等待并取出任务的返回值，任务抛出的异常会在这里重新抛出；无效的TaskFuture抛出TaskCancelledError
+    R get() {
+        if (!m_state) {
+            throw TaskCancelledError(TaskStatus::STATUS_CANCELLED);
+        }
+        detail::FutureState<R>* state = m_state;
+        m_state = nullptr;
+        struct Releaser {
+            detail::FutureState<R>* state;
+            ~Releaser() { state->release(); }
+        } releaser{ state };
+        return state->get();
+    }
+
+    // 任务完成后把func(返回值)投递到pool执行，返回下游任务的TaskFuture，不会阻塞任何线程
+    // 调用后当前TaskFuture不再关联任务；上游抛出的异常直接传递给下游，不会调用func；当前TaskFuture无效时返回无效的TaskFuture
+    template<typename F>
+    auto then(ThreadPool& pool, F&& func)
+        -> TaskFuture<detail::ContinuationResult<F, R>>;
+
+    // 任务完成时在完成它的线程上调用callback；已经完成（或者TaskFuture无效）时返回false，callback不会被调用
+    template<typename F>
+    bool onReady(F&& callback) {
+        if (!m_state) {
+            return false;
+        }
+        Job job(std::forward<F>(callback));
+        return m_state->addContinuation(job);
+    }
+
+private:
+    detail::FutureState<R>* m_state;
+};
+
 // 前向声明
 class Task;
 
 // 实现接收提交到线程池的task任务执行完成后的返回值Result
-class Result {
+class Result : public std::enable_shared_from_this<Result> {
 public:
     Result(std::shared_ptr<Task> task, bool isValid = true);
     ~Result() = default;
 
     // setValue 获取任务执行完的返回值
     void setValue(Any any);
+    // setCancelled 任务没有执行就被取消或者过期，get()返回空的Any
+    void setCancelled(TaskStatus status);
     // get 用户调用这个方法获取task执行结果
+    // 在工作线程上调用时，任务还没有开始就直接在本线程执行，否则等待期间执行其他排队的任务
     Any get();
 
+    // ready 任务是否已经执行完成，不会阻塞
+    bool ready() const;
+    // status 任务的完成状态，提交失败的Result返回STATUS_CANCELLED
+    TaskStatus status() const;
+    // waitFor 最多等待一段时间，返回任务是否已经执行完成
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout) {
+        return !m_isValid || m_event.waitFor(timeout);
+    }
+    // waitUntil 最多等待到某个时间点，返回任务是否已经执行完成
+    template<typename Clock, typename Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+        return !m_isValid || m_event.waitUntil(deadline);
+    }
+    // then 任务完成后把func(返回值)投递到pool执行，返回值只能被get()或then()取走一次
+    // 提交失败的Result不会调用func，返回的TaskFuture得到broken_promise异常
+    template<typename F>
+    auto then(ThreadPool& pool, F&& func)
+        -> TaskFuture<detail::InvokeResult<F, Any>>;
+    // onReady 任务完成时在完成它的线程上调用callback；已经完成或提交失败时返回false，callback不会被调用
+    template<typename F>
+    bool onReady(F&& callback) {
+        if (!m_isValid) {
+            return false;
+        }
+        Job job(std::forward<F>(callback));
+        return m_continuations.add(job);
+    }
+
+private:
+    void complete(Any any, TaskStatus status);
+
 private:
     Any m_any; // 存储任务的返回值
-    Semaphore m_semaphore; // 线程通信信号量
+    std::atomic<TaskStatus> m_status; // 任务的完成状态
+    OneShotEvent m_event; // 任务完成事件
+    detail::ContinuationList m_continuations; // 任务完成后要执行的回调
     std::weak_ptr<Task> m_task; // 任务指针
     std::atomic<bool> m_isValid; // 任务是否执行完成
 };
@@ -120,17 +1082,95 @@ public:
     virtual ~Task() = default;
 
     void execute();
+    // 任务没有执行就被丢弃（关闭线程池时取消排队的任务，或者令牌被取消、过期），Result::get()返回空的Any
+    void cancel(TaskStatus status = TaskStatus::STATUS_CANCELLED);
     void setResultPtr(std::shared_ptr<Result> resultPtr);
     // 纯虚函数，不能够使用模板
     virtual Any run() = 0;
 private:
+    friend class Result;
+    friend class ThreadPool;
+
+    // 一次提交只有第一个调用者能执行或者取消任务：等待结果的工作线程直接执行之后，队列中的任务出队时什么也不做
+    bool claim();
+
     std::shared_ptr<Result> m_resultPtr;
+    std::atomic<bool> m_claimed; // 本次提交是否已经开始执行或者被取消
+    bool m_inlinable; // 没有取消令牌和过期时间，可以由等待结果的工作线程直接执行
 };
 
+// 在内存池中创建任务对象，对象和shared_ptr的控制块放在同一个内存块中
+// 用法与std::make_shared相同：pool.submitTask(makeTask<MyTask>(0, 100))
+template<typename T, typename... Args>
+std::shared_ptr<T> makeTask(Args&&... args) {
+    return std::allocate_shared<T>(detail::PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
 // 线程池支持的模式
 enum class PoolMode {
-    MODE_FIXED, // 固定线程数量
-    MODE_CACHED // 可动态调整线程数量
+    MODE_FIXED,   // 固定线程数量
+    MODE_CACHED,  // 可动态调整线程数量
+    MODE_ADAPTIVE // 由控制线程根据排队时间和吞吐量调整线程数量
+};
+
+// 任务队列的组织方式
+enum class QueueMode {
+    QUEUE_SHARED,       // 所有线程共享一个任务队列
+    QUEUE_WORK_STEALING, // 每个线程拥有自己的双端队列，空闲时从其他线程窃取任务
+    QUEUE_LOCK_FREE,    // 容量固定的无锁环形队列，只在队列为空或已满时才需要等待
+    QUEUE_PRIORITY      // 按紧急程度排序的共享队列，总是先执行最紧急的任务
+};
+
+// 工作线程的CPU绑定方式
+enum class AffinityMode {
+    AFFINITY_NONE, // 不绑定，由操作系统调度
+    AFFINITY_CPU,  // 每个线程绑定到一个CPU
+    AFFINITY_NODE  // 每个线程绑定到一个NUMA节点的所有CPU
+};
+
+// 工作线程没有任务时的等待方式
+enum class IdleStrategy {
+    IDLE_PARK,           // 直接在条件变量上睡眠，不占用CPU，适合批处理（默认）
+    IDLE_SPIN_THEN_PARK  // 先自旋，再让出CPU，最后才睡眠；有线程在自旋时提交任务不需要唤醒，适合对延迟敏感的场景
+};
+
+// 任务队列已满时的处理方式
+enum class OverflowPolicy {
+    OVERFLOW_BLOCK,       // 等待队列出现空位，最多等待setSubmitTimeout设置的时间（默认1s）
+    OVERFLOW_REJECT,      // 立即提交失败
+    OVERFLOW_CALLER_RUNS, // 在提交线程上直接执行，生产者被自然地拖慢
+    OVERFLOW_DROP_OLDEST  // 丢弃最早排队的任务（优先级队列中是最不紧急的任务），为新任务腾出空位
+};
+
+// 排队任务数量越过的水位线
+enum class QueueWatermark {
+    WATERMARK_HIGH, // 排队任务数量达到高水位
+    WATERMARK_LOW   // 达到高水位之后又回落到低水位
+};
+
+// 关闭线程池的方式
+enum class ShutdownMode {
+    SHUTDOWN_DRAIN,         // 执行完所有已经提交的任务
+    SHUTDOWN_CANCEL_PENDING // 丢弃还没有开始执行的任务，只等待正在执行的任务
+};
+
+// 任务的优先级，只在QUEUE_PRIORITY模式下生效
+enum class TaskPriority {
+    PRIORITY_HIGH,   // 交互请求等对延迟敏感的任务
+    PRIORITY_NORMAL,
+    PRIORITY_LOW     // 后台批处理任务
+};
+
+// 提交任务时的调度选项
+// 优先级队列按虚拟截止时间排序：提交时间 + 优先级等级 * 老化步长，有显式截止时间时取两者中较早的一个。
+// 等待得足够久的低优先级任务会排到新提交的高优先级任务前面，不会一直饿死。
+// 带有取消令牌或者过期时间的任务出队时先检查令牌，已经取消或过期的任务不会执行，
+// TaskFuture::get()抛出TaskCancelledError，Result::get()返回空的Any，status()报告原因
+struct TaskOptions {
+    TaskPriority priority = TaskPriority::PRIORITY_NORMAL;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // 希望最晚开始执行的时间
+    CancellationToken token; // 取消令牌
+    std::chrono::steady_clock::time_point expireAt = std::chrono::steady_clock::time_point::max(); // 到期还没有开始执行就不再执行，执行中的任务通过令牌感知
 };
 
 // 线程类
@@ -139,55 +1179,351 @@ public:
     using ThreadFunc = std::function<void(int)>;
 
     Thread(ThreadFunc func);
+    // 析构时等待线程结束
     ~Thread();
 
     // 启动线程
     void start();
+    // 等待线程结束
+    void join();
+    // 当前是否在这个线程上执行
+    bool isCurrentThread() const;
 
     // 获取线程id
     int getThreadId() const;
 
 private:
     ThreadFunc threadfunc;
-    static int generateId;
+    static std::atomic<int> generateId;
     int threadId; //  线程id
+    std::thread thread;
+};
+
+namespace detail {
+struct TimerState;
+class TimerQueue;
+}
+
+// 前向声明，定义在executor_group.h中
+class ThreadBudget;
+struct LaneAccount;
+
+// scheduleAfter / scheduleAt / scheduleEvery 返回的句柄，用于取消定时任务
+class TimerHandle {
+public:
+    TimerHandle() = default;
+    TimerHandle(std::weak_ptr<detail::TimerQueue> queue, std::shared_ptr<detail::TimerState> state)
+        : m_queue(std::move(queue)), m_state(std::move(state)) {}
+
+    // 取消定时任务，返回任务是否还在等待；取消后不会再开始新的执行，已经开始的那一次不受影响
+    bool cancel();
+    // 定时任务是否还会执行：没有被取消，并且是周期任务或者还没有到期
+    bool active() const;
+
+private:
+    std::weak_ptr<detail::TimerQueue> m_queue;
+    std::shared_ptr<detail::TimerState> m_state;
 };
 
 // 线程池类
 class ThreadPool {
 public:
     ThreadPool(); 
+    // 不能在本线程池的工作线程上析构（进程会中止）
     ~ThreadPool();
     ThreadPool(const ThreadPool& ) = delete;
     ThreadPool &operator= (const ThreadPool& ) = delete;
 
     // 设置线程池工作模式
     void setMode(PoolMode mode);
+    // 设置任务队列的组织方式
+    void setQueueMode(QueueMode mode);
+    // 设置工作线程的CPU绑定方式
+    // 绑定后工作线程按NUMA节点分组：工作窃取模式下外部提交的任务进入提交线程所在节点的队列，
+    // 窃取时先在本节点内进行，本节点没有任务时才跨节点
+    void setAffinityMode(AffinityMode mode);
 
-    // 设置taskQueue最大容纳任务数
+    // 设置taskQueue最大容纳任务数，所有模式下都生效
     void setTaskQueueLimit(size_t size);
     // 设置Cached模式下的线程数量上限
     void setThreadSizeLimit(size_t size);
+    // 设置Cached和Adaptive模式下多余线程的空闲回收时间
+    void setThreadIdleTimeout(std::chrono::steady_clock::duration timeout);
+    // 设置Adaptive模式下期望的任务排队时间，估计的排队时间持续超过它时增加线程
+    void setTargetQueueWait(std::chrono::steady_clock::duration wait);
+    // 设置共享队列模式下工作线程每次加锁最多取出的任务数量
+    void setDequeueBatchSize(size_t size);
+    // 设置优先级队列的老化步长：优先级每低一级，虚拟截止时间推后一个步长
+    void setPriorityAging(std::chrono::steady_clock::duration step);
+    // 设置任务队列已满时的处理方式，对submitTask、submitBatch、submit和post生效
+    void setOverflowPolicy(OverflowPolicy policy);
+    // 设置OVERFLOW_BLOCK模式下提交者最多等待的时间
+    void setSubmitTimeout(std::chrono::steady_clock::duration timeout);
+    // 设置排队任务数量的水位线：达到high时调用callback(WATERMARK_HIGH, 数量)，之后回落到low时调用callback(WATERMARK_LOW, 数量)
+    // 两种通知交替出现，callback在越过水位线的提交线程或者工作线程上调用，不持有任何锁，可以在其中提交任务
+    void setQueueWatermarks(size_t high, size_t low, std::function<void(QueueWatermark, size_t)> callback);
+    // 设置工作线程没有任务时的等待方式，maxSpin是IDLE_SPIN_THEN_PARK模式下每次空闲最多自旋的时间
+    // 实际的自旋时间按最近的空闲时长自适应：任务通常很快到达时自旋，空闲时间比maxSpin长时直接睡眠
+    void setIdleStrategy(IdleStrategy strategy,
+                         std::chrono::steady_clock::duration maxSpin = std::chrono::microseconds(50));
+    // 是否统计排队时间、执行时间和空闲时间（默认打开），关闭后工作线程不再为统计读取时钟，只保留计数
+    void setMetricsEnabled(bool enabled);
     // 给线程池提交任务
-    std::shared_ptr<Result> submitTask(std::shared_ptr<Task> task);
+    std::shared_ptr<Result> submitTask(std::shared_ptr<Task> task, const TaskOptions& options = TaskOptions());
+    // 批量提交任务，一次加锁放入所有任务，只唤醒需要的线程数量
+    std::vector<std::shared_ptr<Result>> submitBatch(const std::vector<std::shared_ptr<Task>>& tasks,
+                                                     const TaskOptions& options = TaskOptions());
+    template<typename Iterator>
+    std::vector<std::shared_ptr<Result>> submitBatch(Iterator first, Iterator last, const TaskOptions& options = TaskOptions()) {
+        return submitBatch(std::vector<std::shared_ptr<Task>>(first, last), options);
+    }
+
+    // 提交任意可调用对象及其参数，返回类型安全的TaskFuture
+    // 小的可调用对象直接存放在任务队列的元素中，不需要继承Task，也不经过Any
+    template<typename F, typename... Args,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskOptions>::value>::type>
+    auto submit(F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>> {
+        return submit(TaskOptions(), std::forward<F>(func), std::forward<Args>(args)...);
+    }
+    // 带调度选项提交
+    template<typename F, typename... Args>
+    auto submit(const TaskOptions& options, F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>>;
+
+    // 不阻塞的提交：队列已满时立即返回无效的TaskFuture（valid()为false），不受OverflowPolicy影响
+    template<typename F, typename... Args,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskOptions>::value>::type>
+    auto trySubmit(F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>> {
+        return trySubmit(TaskOptions(), std::forward<F>(func), std::forward<Args>(args)...);
+    }
+    template<typename F, typename... Args>
+    auto trySubmit(const TaskOptions& options, F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>> {
+        return submitFor(std::chrono::steady_clock::duration::zero(), options, std::forward<F>(func), std::forward<Args>(args)...);
+    }
+    // 队列已满时最多等待timeout，仍然没有空位时返回无效的TaskFuture，不受OverflowPolicy影响
+    template<typename Rep, typename Period, typename F, typename... Args,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskOptions>::value>::type>
+    auto submitFor(const std::chrono::duration<Rep, Period>& timeout, F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>> {
+        return submitFor(timeout, TaskOptions(), std::forward<F>(func), std::forward<Args>(args)...);
+    }
+    // 带调度选项提交，优先级、截止时间和取消令牌与submit(options, ...)相同
+    template<typename Rep, typename Period, typename F, typename... Args>
+    auto submitFor(const std::chrono::duration<Rep, Period>& timeout, const TaskOptions& options, F&& func, Args&&... args)
+        -> TaskFuture<detail::InvokeResult<F, Args...>>;
 
-    // 启动线程池
+    // 提交不需要返回值的可调用对象，不分配共享状态；提交失败时返回false，func随之销毁
+    template<typename F>
+    bool post(F&& func, const TaskOptions& options = TaskOptions()) {
+        return enqueueJob(makeJob(std::forward<F>(func), options), options);
+    }
+    // 不阻塞的post：队列已满时立即返回false，不受OverflowPolicy影响，也不会在调用线程上执行
+    template<typename F>
+    bool tryPost(F&& func, const TaskOptions& options = TaskOptions()) {
+        return enqueueJobFor(makeJob(std::forward<F>(func), options), options, std::chrono::steady_clock::duration::zero());
+    }
+
+    // 定时任务：到期后把func投递到任务队列，等待期间不占用工作线程
+    // 到期时队列已满则跳过这一次（计入rejectedTasks），不受OverflowPolicy影响
+    // 所有定时任务共用一个分层时间轮和一个定时线程，精度为1ms；线程池析构时未到期的定时任务被丢弃
+    template<typename Rep, typename Period, typename F>
+    TimerHandle scheduleAfter(const std::chrono::duration<Rep, Period>& delay, F&& func) {
+        return scheduleJob(Job(std::forward<F>(func)),
+                           std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay),
+                           std::chrono::steady_clock::duration::zero());
+    }
+    template<typename Clock, typename Duration, typename F>
+    TimerHandle scheduleAt(const std::chrono::time_point<Clock, Duration>& when, F&& func) {
+        return scheduleAfter(when - Clock::now(), std::forward<F>(func));
+    }
+    // 周期任务：第一次在一个周期之后执行；上一次还在排队或者执行时跳过本次，不会在队列中积压
+    template<typename Rep, typename Period, typename F>
+    TimerHandle scheduleEvery(const std::chrono::duration<Rep, Period>& period, F&& func) {
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+        return scheduleJob(Job(std::forward<F>(func)), std::chrono::steady_clock::now() + interval, interval);
+    }
+
+#ifdef __cpp_impl_coroutine
+    // co_await pool.schedule() 把当前协程转移到工作线程上继续执行，定义在coroutine.h中
+    ScheduleAwaiter schedule(const TaskOptions& options = TaskOptions());
+#endif
+
+    // 启动线程池；已经在运行或者已经关闭时只输出错误信息
     void start(size_t initialThreadSize = std::thread::hardware_concurrency());
 
+    // 关闭线程池：停止接受新任务，停止定时任务，按mode处理排队的任务，返回时所有工作线程都已经退出
+    // 丢弃的任务：TaskFuture得到broken_promise异常，Result::get()返回空的Any；重复调用不做任何事
+    // 在工作线程上调用时不等待调用者自己退出，由析构函数join它；析构函数会调用shutdown(SHUTDOWN_DRAIN)
+    void shutdown(ShutdownMode mode = ShutdownMode::SHUTDOWN_DRAIN);
+    // 相当于shutdown(SHUTDOWN_CANCEL_PENDING)，返回被丢弃的任务数量
+    size_t shutdownNow();
+
+    // 当前线程总数和空闲线程数
+    size_t getTotalThreadSize() const;
+    size_t getIdleThreadSize() const;
+
+    // 读取所有工作线程的指标并汇总，不加锁，可以随时调用
+    PoolMetrics snapshot() const;
+
 private:
+    friend void detail::helpWait(OneShotEvent& event);
+    friend class ExecutorGroup;
+    friend class detail::TimerQueue;
+
+    // 一次提交遇到队列已满时的处理方式
+    struct OverflowControl {
+        OverflowControl(OverflowPolicy policy, std::chrono::steady_clock::duration wait, bool report)
+            : policy(policy), wait(wait), report(report) {}
+
+        // 第一次需要等待时才读取时钟，之后同一次提交的所有等待共用这个截止时间
+        std::chrono::steady_clock::time_point deadline() {
+            if (waitDeadline == std::chrono::steady_clock::time_point()) {
+                waitDeadline = std::chrono::steady_clock::now() + wait;
+            }
+            return waitDeadline;
+        }
+
+        OverflowPolicy policy;
+        std::chrono::steady_clock::duration wait; // OVERFLOW_BLOCK时最多等待的时间
+        bool report; // 提交失败时是否输出错误信息
+        std::chrono::steady_clock::time_point waitDeadline;
+        std::vector<Job> dropped; // OVERFLOW_DROP_OLDEST挤出的任务，在锁外销毁
+    };
+
     // 线程函数
     void threadFunc(int threadId);
 
     // 检查pool的运行状态
     bool checkPoolRunning() const;
 
+    // 作为ExecutorGroup的通道：创建线程之前向共享的预算申请，线程退出后归还，启动之前设置
+    void setThreadBudget(std::shared_ptr<ThreadBudget> budget, LaneAccount* account);
+    // 有预算时归还一个线程，调用时需持有taskQueueMutex
+    void releaseThreadBudget();
+
+    // 当前是否有待执行的任务
+    bool hasPendingTask() const;
+    // 当前线程是否是本线程池的工作线程
+    bool isWorkerThread() const;
+
+    // 工作队列槽位的分配与归还，调用时需持有taskQueueMutex
+    int acquireWorkerSlot();
+    void releaseWorkerSlot(int slot);
+    // 按CPU拓扑为每个槽位分配CPU和NUMA节点，并在对应节点上分配工作队列
+    void placeWorkerSlots(size_t slotSize);
+    // 提交线程所在节点的槽位，不知道所在节点时返回所有槽位
+    const std::vector<int>& localWorkerSlots() const;
+
+    // 调度选项带有取消令牌或者过期时间时，把任务包装成出队时先检查令牌的CancellableJob
+    template<typename Inner>
+    Job makeJob(Inner&& inner, const TaskOptions& options) {
+        using Fn = typename std::decay<Inner>::type;
+        CancellationToken token = options.token.withDeadline(options.expireAt);
+        if (!token.cancellable()) {
+            return Job(std::forward<Inner>(inner));
+        }
+        return Job(detail::CancellableJob<Fn>(std::forward<Inner>(inner), std::move(token), &skippedTasks));
+    }
+
+    // 把任务放入任务队列，失败时返回false
+    bool enqueueJob(Job job, const TaskOptions& options);
+    // 队列已满时最多等待wait，不受OverflowPolicy影响
+    bool enqueueJobFor(Job job, const TaskOptions& options, std::chrono::steady_clock::duration wait);
+    // 按顺序把一批任务放入任务队列，返回成功放入的数量
+    size_t enqueueJobs(Job* jobs, size_t count, const TaskOptions& options);
+    size_t enqueueJobs(Job* jobs, size_t count, const TaskOptions& options, OverflowControl& overflow);
+    // 处理没能放入队列的任务：CALLER_RUNS时在当前线程上执行，否则记为提交失败；返回执行的数量
+    size_t finishOverflow(Job* jobs, size_t count, OverflowControl& overflow);
+    // 排队任务数量越过水位线时调用回调
+    void checkWatermarks();
+
+    // 共享队列和优先级队列都由taskQueueMutex保护，以下函数调用时需持有该锁
+    bool isLockedQueue() const;
+    size_t lockedQueueSize() const;
+    void pushLockedTask(Job job, std::chrono::steady_clock::time_point urgency);
+    Job popLockedTask();
+    // 队列已满时按overflow腾出空位或者等待，返回是否可以继续放入
+    bool makeLockedRoom(std::unique_lock<std::mutex>& lock, OverflowControl& overflow);
+    // 根据调度选项计算任务在优先级队列中的虚拟截止时间
+    std::chrono::steady_clock::time_point taskUrgency(const TaskOptions& options) const;
+
+    // 预留最多count个任务名额，任务总数达到上限时等待（最多1s），返回预留的数量
+    size_t reserveTaskSlots(size_t count, OverflowControl& overflow);
+    // 从工作队列头部丢弃一个最早提交的任务
+    bool dropOldestWorkerTask(std::vector<Job>& dropped);
+    // 把任务放入工作队列：任务内部提交的放入本线程队列尾部，外部提交的轮流分散到各个队列
+    void pushWorkerTasks(Job* jobs, size_t count);
+    // 优先从本线程队列尾部取任务（LIFO），取不到再从其他线程队列头部窃取（FIFO）
+    Job popWorkerTask(int slot);
+    // 无锁环形队列的入队和出队
+    bool pushRingTask(Job& job, OverflowControl& overflow);
+    Job popRingTask();
+    // 自旋等待任务，最多等待budget，返回是否等到了任务（或者线程池正在关闭）
+    bool spinForTask(std::chrono::nanoseconds budget);
+    // 执行一个任务并记录指标，返回执行结束的时间
+    std::chrono::steady_clock::time_point runJob(Job& job, detail::WorkerStats& stats);
+    // 不等待地取出并执行一个排队的任务（先本线程批量取出的，再按队列模式取），没有任务时返回false
+    bool runPendingTask(int slot);
+    // 在工作线程上等待event，等待期间执行排队的任务；没有任务时阻塞，直到event完成或者有新任务入队
+    void helpUntil(OneShotEvent& event, int slot);
+    // 嵌套层数达到上限的线程阻塞之前，增加一个线程代替它执行排队的任务
+    void compensateBlockedWorker();
+    // 唤醒最多count个正在睡眠的工作线程，正在自旋的线程会自己取走任务，不需要唤醒
+    void notifyWorkers(size_t count);
+    // 同上，调用时需持有taskQueueMutex
+    void wakeWorkers(size_t count);
+    // 在Cached模式下根据任务数量按需创建新线程，调用时需持有taskQueueMutex
+    void growThreadsIfNeeded();
+    // Cached模式下排队的任务是否多于可用的线程，并且还可以增加线程
+    bool needsCachedThread() const;
+    // 创建一个工作线程并加入threads，返回的线程还没有启动；线程池已经停止时返回nullptr
+    // 顺便回收已经退出的线程，调用时需持有taskQueueMutex
+    Thread* addWorkerThread();
+    // 取出所有排队的任务，返回取出的数量，由调用者在锁外销毁
+    size_t takePendingTasks(std::vector<Job>& jobs);
+    // Adaptive模式的控制线程：定期采样排队长度和吞吐量，决定是否增加线程
+    void controllerFunc();
+    // 所有槽位执行过的任务总数
+    uint64_t executedTaskSize() const;
+    void stopController();
+    // 把定时任务插入时间轮，period为0表示只执行一次
+    TimerHandle scheduleJob(Job job, std::chrono::steady_clock::time_point when, std::chrono::steady_clock::duration period);
+
 private:
+    // 每个工作线程私有的任务双端队列
+    // 末尾填充到一个缓存行以上，避免相邻队列之间的伪共享
+    struct WorkerQueue {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+        char padding[64];
+    };
+
+    // 槽位的放置：绑定的CPU、所在节点，以及窃取任务时依次查看的其他槽位（先本节点，后其他节点）
+    struct WorkerPlacement {
+        std::vector<int> cpus;
+        int node;
+        std::vector<int> stealOrder;
+    };
+
+    // 优先级队列中的任务，urgency越早越紧急，相同时按提交顺序执行
+    struct PriorityJob {
+        Job job;
+        std::chrono::steady_clock::time_point urgency;
+        uint64_t sequence;
+    };
+    // 堆比较函数：a不如b紧急时返回true，堆顶是最紧急的任务
+    static bool lessUrgent(const PriorityJob& a, const PriorityJob& b);
+
     std::unordered_map<int, std::unique_ptr<Thread>> threads; // 线程列表
+    std::vector<std::unique_ptr<Thread>> exitedThreads; // 空闲回收后退出、还没有join的线程
     size_t initialThreadSize;        // 初始线程数量
     std::atomic<int> idleThreadSize; // 表示当前线程池中空闲线程的数量
     std::atomic<int> totalThreadSize; // 表示当前线程池中线程的总数量
     
-    std::queue<std::shared_ptr<Task>> taskQueue; // 任务队列
+    std::queue<Job> taskQueue; // 任务队列
     std::atomic<size_t> taskSize; // 任务计数器
     size_t taskQueueLimit; // 任务队列大小上限
     size_t threadSizeLimit; // Cached模式下的线程数量上限
@@ -195,9 +1531,161 @@ private:
     std::mutex taskQueueMutex; // 任务队列互斥锁
     std::condition_variable notEmpty; // 任务队列非空条件变量
     std::condition_variable notFull; // 任务队列非满条件变量
-    std::condition_variable exitThreadPool; // 退出线程池条件变量
+
+    std::vector<std::unique_ptr<WorkerQueue>> workerQueues; // 每个工作线程的任务队列
+    std::vector<int> workerSlotUsers; // 每个工作队列当前被多少个线程占用
+    std::atomic<size_t> nextWorkerQueue; // 外部提交任务时轮流选择的队列下标
+    std::atomic<int> sleepingThreadSize; // 正在条件变量上睡眠的线程数量
+    std::atomic<int> spinningThreadSize; // 正在自旋等待任务的线程数量
+    std::atomic<int> helpingThreadSize; // 在任务内部等待结果、暂时没有排队任务可以执行的线程数量
+    std::vector<OneShotEvent*> helpingEvents; // 这些线程阻塞在其上的事件，有新任务时打断等待，由taskQueueMutex保护
+
+    std::shared_ptr<ThreadBudget> threadBudget; // 所属ExecutorGroup的线程预算，独立使用时为空
+    LaneAccount* budgetAccount; // 在预算中的账户
+
+    IdleStrategy idleStrategy; // 工作线程没有任务时的等待方式
+    std::chrono::steady_clock::duration maxSpin; // 每次空闲最多自旋的时间
+
+    AffinityMode affinityMode; // 工作线程的CPU绑定方式
+    CpuTopology topology; // 启动时读取的CPU拓扑
+    std::vector<WorkerPlacement> workerPlacements; // 每个槽位的放置
+    std::vector<std::vector<int>> nodeWorkerSlots; // 每个节点的槽位，不绑定时只有一组
+    std::vector<int> allWorkerSlots; // 所有槽位
+
+    std::unique_ptr<MpmcQueue<Job>> ringQueue; // 无锁环形任务队列
+    std::atomic<int> waitingSubmitterSize; // 因环形队列已满而等待的提交者数量
+
+    std::vector<PriorityJob> priorityQueue; // 优先级任务队列（二叉堆）
+    uint64_t prioritySequence; // 优先级队列的提交序号
+    std::chrono::steady_clock::duration priorityAging; // 优先级老化步长
+
+    std::shared_ptr<detail::TimerQueue> timerQueue; // 定时任务的时间轮和定时线程
+
+    std::chrono::steady_clock::duration threadIdleTimeout; // 多余线程的空闲回收时间
+    std::chrono::steady_clock::duration targetQueueWait; // Adaptive模式下期望的排队时间
+    std::thread controllerThread; // Adaptive模式的控制线程
+    std::mutex controllerMutex;
+    std::condition_variable controllerCond;
+    bool controllerStopping;
+
+    std::vector<std::unique_ptr<detail::WorkerStats>> workerStats; // 每个槽位的指标
+    bool metricsEnabled; // 是否统计时间
+    std::atomic<uint64_t> threadsCreated; // 启动以来创建的线程数量
+    std::atomic<uint64_t> threadsRetired; // 启动以来退出的线程数量
+    std::atomic<uint64_t> rejectedTaskSize; // 提交失败的任务数量
+    std::atomic<uint64_t> droppedTaskSize; // OVERFLOW_DROP_OLDEST丢弃的任务数量
+    std::atomic<uint64_t> callerRunTaskSize; // OVERFLOW_CALLER_RUNS在提交线程上执行的任务数量
+    detail::SkippedTasks skippedTasks; // 因为取消或者过期而跳过的任务数量
+
+    OverflowPolicy overflowPolicy; // 队列已满时的处理方式
+    std::chrono::steady_clock::duration submitTimeout; // OVERFLOW_BLOCK时最多等待的时间
+    size_t highWatermark; // 0表示没有设置水位线
+    size_t lowWatermark;
+    std::function<void(QueueWatermark, size_t)> watermarkCallback;
+    std::atomic<bool> aboveHighWatermark; // 达到高水位之后还没有回落到低水位，由CAS翻转，保证两种通知交替出现
+
+    std::mutex shutdownMutex; // 串行化shutdown的调用
+    bool isShutdown; // shutdown已经调用过，由shutdownMutex保护
+    std::atomic<bool> cancelPending; // 关闭时丢弃还没有执行的任务，工作线程不再执行本地批量取出的任务
+    std::atomic<size_t> discardedTaskSize; // 关闭时丢弃的任务数量
+
     PoolMode mode; // 当前线程池模式
+    QueueMode queueMode; // 当前任务队列的组织方式
+    size_t dequeueBatchSize; // 共享队列模式下每次加锁最多取出的任务数量
     std::atomic<bool> isPoolRunning; // 表示当前线程池的启动状态 
 };
 
+template<typename F, typename... Args>
+auto ThreadPool::submit(const TaskOptions& options, F&& func, Args&&... args)
+    -> TaskFuture<detail::InvokeResult<F, Args...>> {
+    using R = detail::InvokeResult<F, Args...>;
+    using Invoker = detail::TaskInvoker<R, typename std::decay<F>::type, typename std::decay<Args>::type...>;
+
+    auto state = new detail::FutureState<R>();
+    TaskFuture<R> future(state);
+    // 提交失败时Job被销毁，future会得到broken_promise异常
+    enqueueJob(makeJob(Invoker(state, std::forward<F>(func), std::forward<Args>(args)...), options), options);
+    return future;
+}
+
+template<typename Rep, typename Period, typename F, typename... Args>
+auto ThreadPool::submitFor(const std::chrono::duration<Rep, Period>& timeout, const TaskOptions& options, F&& func, Args&&... args)
+    -> TaskFuture<detail::InvokeResult<F, Args...>> {
+    using R = detail::InvokeResult<F, Args...>;
+    using Invoker = detail::TaskInvoker<R, typename std::decay<F>::type, typename std::decay<Args>::type...>;
+
+    auto state = new detail::FutureState<R>();
+    TaskFuture<R> future(state);
+    auto wait = std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+    // 提交失败时Job被销毁，共享状态随之释放
+    if (!enqueueJobFor(makeJob(Invoker(state, std::forward<F>(func), std::forward<Args>(args)...), options), options, wait)) {
+        return TaskFuture<R>();
+    }
+    return future;
+}
+
+template<typename R>
+template<typename F>
+auto TaskFuture<R>::then(ThreadPool& pool, F&& func)
+    -> TaskFuture<detail::ContinuationResult<F, R>> {
+    using R2 = detail::ContinuationResult<F, R>;
+    using Invoker = detail::ContinuationInvoker<R2, detail::FutureRef<R>, typename std::decay<F>::type>;
+
+    if (!m_state) {
+        return TaskFuture<R2>();
+    }
+    auto state = new detail::FutureState<R2>();
+    TaskFuture<R2> future(state);
+    // 当前TaskFuture持有的引用转交给Invoker
+    detail::FutureState<R>* upstream = m_state;
+    m_state = nullptr;
+    // 上游完成时在完成它的线程上执行回调，回调只负责把continuation投递到线程池
+    Job job([&pool, invoker = Invoker(detail::FutureRef<R>(upstream), state, std::forward<F>(func))]() mutable {
+        pool.post(std::move(invoker));
+    });
+    if (!upstream->addContinuation(job)) {
+        job();
+    }
+    return future;
+}
+
+namespace detail {
+
+// 上游是Result时持有它的shared_ptr，取出Any后调用continuation
+class ResultRef {
+public:
+    explicit ResultRef(std::shared_ptr<Result> result) : m_result(std::move(result)) {}
+
+    template<typename F>
+    decltype(auto) apply(F& func) {
+        return func(m_result->get());
+    }
+
+private:
+    std::shared_ptr<Result> m_result;
+};
+
+} // namespace detail
+
+template<typename F>
+auto Result::then(ThreadPool& pool, F&& func)
+    -> TaskFuture<detail::InvokeResult<F, Any>> {
+    using R2 = detail::InvokeResult<F, Any>;
+    using Invoker = detail::ContinuationInvoker<R2, detail::ResultRef, typename std::decay<F>::type>;
+
+    auto state = new detail::FutureState<R2>();
+    TaskFuture<R2> future(state);
+    if (!m_isValid) {
+        detail::TaskPromise<R2> broken(state);
+        return future;
+    }
+    Job job([&pool, invoker = Invoker(detail::ResultRef(shared_from_this()), state, std::forward<F>(func))]() mutable {
+        pool.post(std::move(invoker));
+    });
+    if (!m_continuations.add(job)) {
+        job();
+    }
+    return future;
+}
+
 #endif
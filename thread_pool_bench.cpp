@@ -0,0 +1,481 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+    线程池的性能基准测试，结果以JSON输出，方便在版本之间比较：
+    empty_task_throughput   空任务的提交+执行吞吐量（post和submit两种提交方式，各种队列模式），以及内存池的命中率
+    submit_latency          低负载下从提交到开始执行的延迟分布（主要是唤醒线程的开销），比较直接睡眠和先自旋再睡眠两种等待方式
+    fork_join               任务内部递归提交子任务，最后一个叶子完成时汇合
+    fork_join_wait          任务内部递归提交子任务并用get()等待结果，等待期间工作线程执行排队的任务，统计创建的线程数
+    bursty                  多个生产者突发提交，突发之间留出空闲，统计吞吐量和排队延迟
+    scaling                 固定工作量的CPU密集任务在1~N个线程下的吞吐量，Fixed和Cached两种模式
+
+    用法：thread_pool_bench [--quick] [--repeat N] [--max-threads N] [--output FILE]
+    线程池自身输出到std::cout的日志会被丢弃，JSON写到标准输出或者--output指定的文件。
+*/
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    bool quick = false;
+    int repeat = 3;               // 吞吐量类测试重复的次数，取中位数
+    size_t maxThreads = 0;        // scaling测试的最大线程数，0表示CPU数量
+    std::string output;           // 为空时输出到标准输出
+};
+
+// 一条测试结果：有序的键值对，值已经是JSON格式
+class BenchResult {
+public:
+    explicit BenchResult(const std::string& benchmark) {
+        add("benchmark", benchmark);
+    }
+
+    BenchResult& add(const std::string& key, const std::string& value) {
+        m_fields.emplace_back(key, quote(value));
+        return *this;
+    }
+    BenchResult& add(const std::string& key, const char* value) {
+        return add(key, std::string(value));
+    }
+    BenchResult& add(const std::string& key, double value) {
+        std::ostringstream stream;
+        stream << std::fixed << std::setprecision(3) << value;
+        m_fields.emplace_back(key, stream.str());
+        return *this;
+    }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value, BenchResult&>::type add(const std::string& key, T value) {
+        m_fields.emplace_back(key, std::to_string(value));
+        return *this;
+    }
+
+    void write(std::ostream& out) const {
+        out << "{";
+        for (size_t i = 0; i < m_fields.size(); i++) {
+            out << (i ? ", " : "") << quote(m_fields[i].first) << ": " << m_fields[i].second;
+        }
+        out << "}";
+    }
+
+    static std::string quote(const std::string& text) {
+        std::string quoted = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> m_fields;
+};
+
+const char* modeName(PoolMode mode) {
+    switch (mode) {
+        case PoolMode::MODE_FIXED: return "fixed";
+        case PoolMode::MODE_CACHED: return "cached";
+        case PoolMode::MODE_ADAPTIVE: return "adaptive";
+    }
+    return "unknown";
+}
+
+const char* queueName(QueueMode mode) {
+    switch (mode) {
+        case QueueMode::QUEUE_SHARED: return "shared";
+        case QueueMode::QUEUE_WORK_STEALING: return "work_stealing";
+        case QueueMode::QUEUE_LOCK_FREE: return "lock_free";
+        case QueueMode::QUEUE_PRIORITY: return "priority";
+    }
+    return "unknown";
+}
+
+const char* idleName(IdleStrategy strategy) {
+    switch (strategy) {
+        case IdleStrategy::IDLE_PARK: return "park";
+        case IdleStrategy::IDLE_SPIN_THEN_PARK: return "spin_then_park";
+    }
+    return "unknown";
+}
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+uint64_t nanosBetween(Clock::time_point from, Clock::time_point to) {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    return nanos > 0 ? static_cast<uint64_t>(nanos) : 0;
+}
+
+// 忙等一段时间，模拟CPU密集的工作
+void spinFor(std::chrono::nanoseconds duration) {
+    auto end = Clock::now() + duration;
+    while (Clock::now() < end) {
+    }
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// 在排好序的样本上加上p50/p90/p99/p999/max
+void addPercentiles(BenchResult& result, std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double p) {
+        size_t index = static_cast<size_t>(p * (samples.size() - 1));
+        return samples[index];
+    };
+    result.add("p50_ns", at(0.50)).add("p90_ns", at(0.90)).add("p99_ns", at(0.99))
+          .add("p999_ns", at(0.999)).add("max_ns", samples.back());
+}
+
+// 等待一组post提交的任务全部完成
+class Countdown {
+public:
+    explicit Countdown(size_t count) : m_remaining(count) {}
+
+    void done() {
+        if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            m_event.set();
+        }
+    }
+    void wait() {
+        m_event.wait();
+    }
+
+private:
+    std::atomic<size_t> m_remaining;
+    OneShotEvent m_event;
+};
+
+void configure(ThreadPool& pool, PoolMode mode, QueueMode queue) {
+    pool.setMode(mode);
+    pool.setQueueMode(queue);
+}
+
+// 空任务吞吐量：测量提交和调度本身的开销
+void benchEmptyTasks(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t tasks = options.quick ? 20000 : 200000;
+    const size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (QueueMode queue : {QueueMode::QUEUE_SHARED, QueueMode::QUEUE_WORK_STEALING, QueueMode::QUEUE_LOCK_FREE}) {
+        for (const char* api : {"post", "submit"}) {
+            std::vector<double> rates;
+            AllocationStats allocations;
+            for (int r = 0; r < options.repeat; r++) {
+                ThreadPool pool;
+                configure(pool, PoolMode::MODE_FIXED, queue);
+                pool.start(threads);
+                AllocationStats before = pool.snapshot().allocations;
+                auto start = Clock::now();
+                if (std::strcmp(api, "post") == 0) {
+                    Countdown countdown(tasks);
+                    for (size_t i = 0; i < tasks; i++) {
+                        pool.post([&countdown]() { countdown.done(); });
+                    }
+                    countdown.wait();
+                } else {
+                    std::vector<TaskFuture<void>> futures;
+                    futures.reserve(tasks);
+                    for (size_t i = 0; i < tasks; i++) {
+                        futures.push_back(pool.submit([]() {}));
+                    }
+                    for (auto& future : futures) {
+                        future.get();
+                    }
+                }
+                rates.push_back(tasks / secondsSince(start));
+                AllocationStats after = pool.snapshot().allocations;
+                allocations.allocations += after.allocations - before.allocations;
+                allocations.heapAllocations += after.heapAllocations - before.heapAllocations;
+                allocations.oversized += after.oversized - before.oversized;
+            }
+            results.push_back(BenchResult("empty_task_throughput")
+                .add("mode", modeName(PoolMode::MODE_FIXED)).add("queue", queueName(queue)).add("api", api)
+                .add("threads", threads).add("tasks", tasks).add("tasks_per_second", median(rates))
+                .add("block_pool_allocations", allocations.allocations + allocations.oversized)
+                .add("block_pool_hit_rate", allocations.hitRate()));
+        }
+    }
+}
+
+// 提交到开始执行的延迟：每次提交之间留出空隙，工作线程大多处于睡眠状态
+void benchSubmitLatency(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t samples = options.quick ? 2000 : 20000;
+    const size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    // 提交间隔约为50us加上sleep的误差，自旋上限要比它长，自适应的预算才不会收缩到0
+    const auto maxSpin = std::chrono::microseconds(500);
+    for (QueueMode queue : {QueueMode::QUEUE_SHARED, QueueMode::QUEUE_WORK_STEALING, QueueMode::QUEUE_LOCK_FREE})
+    for (IdleStrategy idle : {IdleStrategy::IDLE_PARK, IdleStrategy::IDLE_SPIN_THEN_PARK}) {
+        ThreadPool pool;
+        configure(pool, PoolMode::MODE_FIXED, queue);
+        pool.setIdleStrategy(idle, maxSpin);
+        pool.start(threads);
+        std::vector<uint64_t> latencies(samples);
+        Countdown countdown(samples);
+        for (size_t i = 0; i < samples; i++) {
+            auto submitted = Clock::now();
+            pool.post([&latencies, &countdown, i, submitted]() {
+                latencies[i] = nanosBetween(submitted, Clock::now());
+                countdown.done();
+            });
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        countdown.wait();
+        PoolMetrics metrics = pool.snapshot();
+        BenchResult result("submit_latency");
+        result.add("mode", modeName(PoolMode::MODE_FIXED)).add("queue", queueName(queue)).add("idle", idleName(idle))
+              .add("threads", threads).add("samples", samples)
+              .add("spin_hits", metrics.total.spinHits).add("parks", metrics.total.parks);
+        addPercentiles(result, latencies);
+        results.push_back(std::move(result));
+    }
+}
+
+// 递归fork-join：每个节点把右子树提交到线程池，左子树在当前线程上继续，所有叶子完成时汇合
+// 一棵树提交2^depth-1个任务，不超过默认的队列上限，Fixed模式下不会因为队列已满而丢弃任务
+struct ForkJoinTree {
+    ThreadPool& pool;
+    Countdown leaves;
+
+    ForkJoinTree(ThreadPool& pool, int depth) : pool(pool), leaves(size_t(1) << depth) {}
+
+    void visit(int depth) {
+        while (depth > 0) {
+            depth--;
+            pool.post([this, depth]() { visit(depth); });
+        }
+        leaves.done();
+    }
+};
+
+void benchForkJoin(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const int depth = 10;
+    const int trees = options.quick ? 20 : 200;
+    const size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (QueueMode queue : {QueueMode::QUEUE_SHARED, QueueMode::QUEUE_WORK_STEALING, QueueMode::QUEUE_LOCK_FREE}) {
+        std::vector<double> rates;
+        for (int r = 0; r < options.repeat; r++) {
+            ThreadPool pool;
+            configure(pool, PoolMode::MODE_FIXED, queue);
+            pool.start(threads);
+            auto start = Clock::now();
+            for (int t = 0; t < trees; t++) {
+                ForkJoinTree tree(pool, depth);
+                pool.post([&tree, depth]() { tree.visit(depth); });
+                tree.leaves.wait();
+            }
+            rates.push_back(trees * static_cast<double>(size_t(1) << depth) / secondsSince(start));
+        }
+        results.push_back(BenchResult("fork_join")
+            .add("mode", modeName(PoolMode::MODE_FIXED)).add("queue", queueName(queue))
+            .add("threads", threads).add("depth", depth).add("trees", trees)
+            .add("tasks_per_second", median(rates)));
+    }
+}
+
+// 阻塞式fork-join：每个节点把右子树提交到线程池，左子树在当前线程上计算，然后等待右子树的结果
+// 等待的工作线程执行排队的任务，Fixed模式不会死锁，Cached模式也不会为等待的线程创建新线程
+uint64_t sumTree(ThreadPool& pool, int depth) {
+    if (depth == 0) {
+        return 1;
+    }
+    auto right = pool.submit(sumTree, std::ref(pool), depth - 1);
+    uint64_t left = sumTree(pool, depth - 1);
+    return left + right.get();
+}
+
+void benchForkJoinWait(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const int depth = 10;
+    const int trees = options.quick ? 20 : 200;
+    const size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED}) {
+        for (QueueMode queue : {QueueMode::QUEUE_SHARED, QueueMode::QUEUE_WORK_STEALING}) {
+            ThreadPool pool;
+            configure(pool, mode, queue);
+            pool.setThreadSizeLimit(threads * 4);
+            pool.start(threads);
+            auto start = Clock::now();
+            for (int t = 0; t < trees; t++) {
+                pool.submit(sumTree, std::ref(pool), depth).get();
+            }
+            double rate = trees * static_cast<double>(size_t(1) << depth) / secondsSince(start);
+            PoolMetrics metrics = pool.snapshot();
+            results.push_back(BenchResult("fork_join_wait")
+                .add("mode", modeName(mode)).add("queue", queueName(queue))
+                .add("threads", threads).add("depth", depth).add("trees", trees)
+                .add("tasks_per_second", rate).add("threads_created", metrics.threadsCreated)
+                .add("helped_tasks", metrics.total.helpedTasks));
+        }
+    }
+}
+
+// 突发负载：多个生产者每次连续提交一批任务，然后空闲一段时间
+void benchBursty(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t producers = 2;
+    const size_t bursts = options.quick ? 20 : 100;
+    const size_t burstSize = 256;
+    const auto work = std::chrono::microseconds(2);
+    const auto gap = std::chrono::milliseconds(2);
+    const size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    const size_t tasks = producers * bursts * burstSize;
+    for (PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED}) {
+        ThreadPool pool;
+        configure(pool, mode, QueueMode::QUEUE_SHARED);
+        pool.setThreadSizeLimit(threads);
+        pool.start(mode == PoolMode::MODE_FIXED ? threads : 1);
+        std::vector<uint64_t> latencies(tasks);
+        Countdown countdown(tasks);
+        auto start = Clock::now();
+        std::vector<std::thread> producerThreads;
+        for (size_t p = 0; p < producers; p++) {
+            producerThreads.emplace_back([&, p]() {
+                for (size_t b = 0; b < bursts; b++) {
+                    for (size_t i = 0; i < burstSize; i++) {
+                        size_t index = (p * bursts + b) * burstSize + i;
+                        auto submitted = Clock::now();
+                        pool.post([&latencies, &countdown, index, submitted, work]() {
+                            latencies[index] = nanosBetween(submitted, Clock::now());
+                            spinFor(work);
+                            countdown.done();
+                        });
+                    }
+                    std::this_thread::sleep_for(gap);
+                }
+            });
+        }
+        for (auto& producer : producerThreads) {
+            producer.join();
+        }
+        countdown.wait();
+        double seconds = secondsSince(start);
+        PoolMetrics metrics = pool.snapshot();
+        BenchResult result("bursty");
+        result.add("mode", modeName(mode)).add("queue", queueName(QueueMode::QUEUE_SHARED))
+              .add("threads", threads).add("producers", producers).add("burst_size", burstSize)
+              .add("tasks", tasks).add("tasks_per_second", tasks / seconds)
+              .add("threads_created", metrics.threadsCreated);
+        addPercentiles(result, latencies);
+        results.push_back(std::move(result));
+    }
+}
+
+// 扩展性：同样的CPU密集工作量分给1~N个线程；Cached模式从1个线程开始，最多扩展到N个
+void benchScaling(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t tasks = options.quick ? 2000 : 20000;
+    const auto work = std::chrono::microseconds(20);
+    size_t maxThreads = options.maxThreads ? options.maxThreads : std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < maxThreads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(maxThreads);
+
+    for (PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED}) {
+        double baseline = 0;
+        for (size_t n : counts) {
+            std::vector<double> rates;
+            uint64_t created = 0;
+            for (int r = 0; r < options.repeat; r++) {
+                ThreadPool pool;
+                configure(pool, mode, QueueMode::QUEUE_SHARED);
+                pool.setThreadSizeLimit(n);
+                pool.start(mode == PoolMode::MODE_FIXED ? n : 1);
+                Countdown countdown(tasks);
+                auto start = Clock::now();
+                for (size_t i = 0; i < tasks; i++) {
+                    pool.post([&countdown, work]() {
+                        spinFor(work);
+                        countdown.done();
+                    });
+                }
+                countdown.wait();
+                rates.push_back(tasks / secondsSince(start));
+                created = pool.snapshot().threadsCreated;
+            }
+            double rate = median(rates);
+            if (baseline == 0) {
+                baseline = rate;
+            }
+            results.push_back(BenchResult("scaling")
+                .add("mode", modeName(mode)).add("queue", queueName(QueueMode::QUEUE_SHARED))
+                .add("threads", n).add("tasks", tasks).add("tasks_per_second", rate)
+                .add("speedup", rate / baseline).add("threads_created", created));
+        }
+    }
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--repeat" && hasValue) {
+            options.repeat = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--max-threads" && hasValue) {
+            options.maxThreads = static_cast<size_t>(std::max(std::atoi(argv[++i]), 1));
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--repeat N] [--max-threads N] [--output FILE]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    benchEmptyTasks(options, results);
+    benchSubmitLatency(options, results);
+    benchForkJoin(options, results);
+    benchForkJoinWait(options, results);
+    benchBursty(options, results);
+    benchScaling(options, results);
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "Cannot open " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    out << "{\n  \"hardware_concurrency\": " << std::thread::hardware_concurrency()
+        << ",\n  \"quick\": " << (options.quick ? "true" : "false")
+        << ",\n  \"repeat\": " << options.repeat
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << "    ";
+        results[i].write(out);
+        out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}" << std::endl;
+    return 0;
+}
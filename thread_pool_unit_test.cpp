@@ -0,0 +1,1254 @@
+#include "thread_pool.h"
+#include "parallel.h"
+#include "task_graph.h"
+#include "executor_group.h"
+#include "strand.h"
+#include "cpu_topology.h"
+#ifdef __cpp_impl_coroutine
+#include "coroutine.h"
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    功能测试：每个测试是一个函数，由ctest运行（也可以 ./thread_pool_unit_test [测试名] 单独运行）。
+    CHECK失败时输出位置并记为失败，不会中断后面的检查；有失败时进程返回非0。
+*/
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                                          \
+    do {                                                                                     \
+        if (!(cond)) {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond << std::endl; \
+            failures++;                                                                      \
+        }                                                                                    \
+    } while (0)
+
+// 期望表达式抛出指定类型的异常
+#define CHECK_THROWS(expr, type)           \
+    do {                                   \
+        bool thrown = false;               \
+        try {                              \
+            (void)(expr);                  \
+        } catch (const type&) {            \
+            thrown = true;                 \
+        } catch (...) {                    \
+        }                                  \
+        CHECK(thrown && #expr " throws " #type); \
+    } while (0)
+
+using namespace std::chrono;
+
+// 让工作线程停在一个任务中，便于在它后面排队
+class Gate {
+public:
+    void wait() const {
+        while (!m_open.load()) {
+            std::this_thread::sleep_for(milliseconds(1));
+        }
+    }
+    void open() {
+        m_open.store(true);
+    }
+
+private:
+    std::atomic<bool> m_open{false};
+};
+
+// 最多等待timeout，直到pred()为true
+template<typename Pred>
+bool eventually(Pred pred, milliseconds timeout = milliseconds(2000)) {
+    auto deadline = steady_clock::now() + timeout;
+    while (!pred()) {
+        if (steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    return true;
+}
+
+class SumTask : public Task {
+public:
+    SumTask(int begin, int end) : m_begin(begin), m_end(end) {}
+    Any run() override {
+        int sum = 0;
+        for (int i = m_begin; i <= m_end; i++) {
+            sum += i;
+        }
+        return sum;
+    }
+
+private:
+    int m_begin, m_end;
+};
+
+const QueueMode QUEUE_MODES[] = {
+    QueueMode::QUEUE_SHARED, QueueMode::QUEUE_WORK_STEALING, QueueMode::QUEUE_LOCK_FREE, QueueMode::QUEUE_PRIORITY
+};
+
+#ifdef __cpp_aligned_new
+// 对齐要求超过max_align_t的返回值：每次构造时检查自己的地址
+std::atomic<int> misaligned(0);
+
+struct alignas(64) OverAligned {
+    explicit OverAligned(int v) : value(v) { check(); }
+    OverAligned(OverAligned&& other) noexcept : value(other.value) { check(); }
+    void check() const {
+        if (reinterpret_cast<uintptr_t>(this) % 64 != 0) {
+            misaligned++;
+        }
+    }
+    int value;
+};
+#endif
+
+void testSubmitFuture() {
+    ThreadPool pool;
+    pool.start(4);
+
+    auto sum = pool.submit([](int a, int b) { return a + b; }, 20, 22);
+    CHECK(sum.valid());
+    CHECK(sum.get() == 42);
+    CHECK(!sum.valid());
+
+    auto failed = pool.submit([]() -> int { throw std::runtime_error("boom"); });
+    CHECK(failed.waitFor(seconds(2)));
+    CHECK(failed.ready());
+    CHECK(failed.status() == TaskStatus::STATUS_COMPLETED);
+    CHECK_THROWS(failed.get(), std::runtime_error);
+
+    std::string text = "thread";
+    auto length = pool.submit([](const std::string& s) { return s.size(); }, text);
+    CHECK(length.get() == text.size());
+
+    auto done = pool.submit([]() {});
+    done.get();
+
+    auto result = pool.submitTask(std::make_shared<SumTask>(1, 100));
+    CHECK(result->get().cast<int>() == 5050);
+    CHECK(result->status() == TaskStatus::STATUS_COMPLETED);
+
+    std::atomic<int> posted(0);
+    for (int i = 0; i < 100; i++) {
+        CHECK(pool.post([&posted]() { posted++; }));
+    }
+    CHECK(eventually([&]() { return posted.load() == 100; }));
+
+    CHECK(parallelReduce(pool, 0, 201, 0, [](int i) { return i; }, [](int a, int b) { return a + b; }) == 20100);
+
+#ifdef __cpp_aligned_new
+    for (int i = 0; i < 8; i++) {
+        CHECK(pool.submit([i]() { return OverAligned(i); }).get().value == i);
+    }
+    CHECK(misaligned == 0);
+#endif
+}
+
+// 工作线程按节点绑定CPU，工作队列在各节点上分配，调用线程自己的CPU绑定保持不变
+void testAffinity() {
+    CpuTopology topology = CpuTopology::detect();
+    std::vector<int> original = CpuTopology::currentThreadCpus();
+    for (AffinityMode mode : { AffinityMode::AFFINITY_NODE, AffinityMode::AFFINITY_CPU }) {
+        ThreadPool pool;
+        pool.setAffinityMode(mode);
+        pool.setQueueMode(QueueMode::QUEUE_WORK_STEALING);
+        pool.start(2);
+        CHECK(CpuTopology::currentThreadCpus() == original);
+
+        std::vector<TaskFuture<std::vector<int>>> futures;
+        for (int i = 0; i < 8; i++) {
+            futures.push_back(pool.submit([]() { return CpuTopology::currentThreadCpus(); }));
+        }
+        for (auto& future : futures) {
+            std::vector<int> cpus = future.get();
+            CHECK(!cpus.empty());
+#ifdef __linux__
+            // 绑定后只能运行在一个节点上；AFFINITY_CPU时只有一个CPU
+            bool sameNode = true;
+            for (int cpu : cpus) {
+                sameNode = sameNode && topology.nodeOfCpu(cpu) == topology.nodeOfCpu(cpus[0]);
+            }
+            CHECK(sameNode);
+            CHECK(AffinityMode::AFFINITY_NODE == mode || cpus.size() == 1);
+#endif
+        }
+        PoolMetrics metrics = pool.snapshot();
+        CHECK(metrics.workers.size() == 2);
+        for (const WorkerMetrics& worker : metrics.workers) {
+            CHECK(worker.node >= 0 && static_cast<size_t>(worker.node) < topology.nodeCount());
+        }
+    }
+}
+
+// 每种队列模式下都能执行submit、submitTask、submitBatch和post提交的任务
+void testQueueModes() {
+    for (QueueMode queueMode : QUEUE_MODES) {
+        for (PoolMode poolMode : { PoolMode::MODE_FIXED, PoolMode::MODE_CACHED }) {
+            ThreadPool pool;
+            pool.setMode(poolMode);
+            pool.setQueueMode(queueMode);
+            pool.start(4);
+
+            std::vector<TaskFuture<int>> futures;
+            for (int i = 0; i < 1000; i++) {
+                futures.push_back(pool.submit([](int x) { return x * 2; }, i));
+            }
+            long total = 0;
+            for (auto& future : futures) {
+                total += future.get();
+            }
+            CHECK(total == 999L * 1000);
+
+            std::vector<std::shared_ptr<Task>> tasks;
+            for (int i = 0; i < 10; i++) {
+                tasks.push_back(std::make_shared<SumTask>(i * 100 + 1, (i + 1) * 100));
+            }
+            int batchTotal = 0;
+            for (auto& result : pool.submitBatch(tasks)) {
+                batchTotal += result->get().cast<int>();
+            }
+            CHECK(batchTotal == 500500);
+
+            std::atomic<int> posted(0);
+            for (int i = 0; i < 200; i++) {
+                pool.post([&posted]() { posted++; });
+            }
+            pool.shutdown();
+            CHECK(posted.load() == 200);
+        }
+    }
+}
+
+// Adaptive模式：估计的排队时间持续超过目标时由控制线程增加线程（不超过上限），空闲后回收到初始数量
+void testAdaptiveMode() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_ADAPTIVE);
+    pool.setThreadSizeLimit(4);
+    pool.setTargetQueueWait(milliseconds(5));
+    pool.setThreadIdleTimeout(milliseconds(100));
+    pool.start(1);
+
+    std::atomic<int> done(0);
+    std::atomic<size_t> maxThreads(0);
+    for (int i = 0; i < 60; i++) {
+        CHECK(pool.post([&]() {
+            size_t total = pool.getTotalThreadSize();
+            size_t seen = maxThreads.load();
+            while (total > seen && !maxThreads.compare_exchange_weak(seen, total)) {
+            }
+            std::this_thread::sleep_for(milliseconds(10));
+            done++;
+        }));
+    }
+    CHECK(eventually([&]() { return pool.getTotalThreadSize() == 4; }));
+    CHECK(eventually([&]() { return done.load() == 60; }, milliseconds(5000)));
+    CHECK(maxThreads.load() <= 4);
+    CHECK(eventually([&]() { return pool.getTotalThreadSize() == 1; }, milliseconds(5000)));
+    PoolMetrics metrics = pool.snapshot();
+    CHECK(metrics.threadsCreated >= 4 && metrics.threadsRetired >= 3);
+}
+
+// IDLE_SPIN_THEN_PARK：任务间隔很短时工作线程在自旋期间等到任务，不需要睡眠；空闲得更久时照常睡眠
+void testIdleSpin() {
+    for (QueueMode queueMode : QUEUE_MODES) {
+        ThreadPool pool;
+        pool.setQueueMode(queueMode);
+        pool.setIdleStrategy(IdleStrategy::IDLE_SPIN_THEN_PARK, milliseconds(5));
+        pool.start(1);
+
+        long total = 0;
+        for (int i = 0; i < 200; i++) {
+            total += pool.submit([i]() { return i; }).get();
+        }
+        CHECK(total == 19900);
+        std::this_thread::sleep_for(milliseconds(50));
+        // 睡眠的线程照常被唤醒
+        CHECK(pool.submit([]() { return 1; }).get() == 1);
+
+        // 计数在任务返回之后才增加，可能晚于get()
+        CHECK(eventually([&]() { return pool.snapshot().total.tasksExecuted == 201; }));
+        PoolMetrics metrics = pool.snapshot();
+        CHECK(metrics.total.spinHits > 0);
+        CHECK(metrics.total.parks > 0);
+    }
+}
+
+// 延迟直方图：按2的幂分桶，百分位取所在桶的上界且不超过最大值；线程池为每个任务记录排队时间和执行时间
+void testLatencyHistograms() {
+    CHECK(LatencyHistogram::bucketOf(0) == 0);
+    CHECK(LatencyHistogram::bucketOf(1) == 1);
+    CHECK(LatencyHistogram::bucketOf(3) == 2);
+    CHECK(LatencyHistogram::bucketOf(1024) == 11);
+    CHECK(LatencyHistogram::bucketOf(UINT64_MAX) == LatencyHistogram::BUCKETS - 1);
+    CHECK(LatencyHistogram::bucketUpperBound(2) == nanoseconds(3));
+
+    AtomicHistogram recorder;
+    for (int i = 0; i < 90; i++) {
+        recorder.record(100);
+    }
+    for (int i = 0; i < 10; i++) {
+        recorder.record(1000000);
+    }
+    LatencyHistogram histogram = recorder.load();
+    CHECK(histogram.count() == 100);
+    CHECK(histogram.max() == nanoseconds(1000000));
+    CHECK(histogram.mean() == nanoseconds((90 * 100 + 10 * 1000000) / 100));
+    CHECK(histogram.percentile(0.5) == nanoseconds(127));
+    CHECK(histogram.percentile(0.9) == nanoseconds(127));
+    CHECK(histogram.percentile(0.99) == nanoseconds(1000000));
+    histogram.merge(recorder.load());
+    CHECK(histogram.count() == 200 && histogram.bucketCount(LatencyHistogram::bucketOf(100)) == 180);
+
+    for (bool enabled : { true, false }) {
+        ThreadPool pool;
+        pool.setMetricsEnabled(enabled);
+        pool.start(2);
+        std::vector<TaskFuture<void>> futures;
+        for (int i = 0; i < 20; i++) {
+            futures.push_back(pool.submit([]() { std::this_thread::sleep_for(milliseconds(2)); }));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+        CHECK(eventually([&]() { return pool.snapshot().total.tasksExecuted == 20; }));
+        WorkerMetrics total = pool.snapshot().total;
+        if (enabled) {
+            CHECK(total.execution.count() == 20 && total.queueWait.count() == 20);
+            CHECK(total.execution.percentile(0.5) >= milliseconds(1));
+            CHECK(total.busyTime >= milliseconds(40));
+        } else {
+            // 关闭后不再读取时钟，只保留计数
+            CHECK(total.execution.count() == 0 && total.queueWait.count() == 0);
+        }
+    }
+}
+
+// 优先级队列先执行紧急的任务
+void testPriorityOrder() {
+    ThreadPool pool;
+    pool.setQueueMode(QueueMode::QUEUE_PRIORITY);
+    pool.start(1);
+
+    Gate gate;
+    std::atomic<bool> blocked(false);
+    pool.post([&]() { blocked = true; gate.wait(); });
+    CHECK(eventually([&]() { return blocked.load(); }));
+
+    std::vector<int> order;
+    std::mutex orderMutex;
+    TaskOptions low, high;
+    low.priority = TaskPriority::PRIORITY_LOW;
+    high.priority = TaskPriority::PRIORITY_HIGH;
+    auto first = pool.submit(low, [&]() { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(0); });
+    auto second = pool.submit(high, [&]() { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(1); });
+    // trySubmit和submitFor同样按选项排序
+    auto third = pool.submitFor(milliseconds(5), low, [&]() { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(2); });
+    auto fourth = pool.trySubmit(high, [&]() { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(3); });
+    CHECK(third.valid() && fourth.valid());
+    gate.open();
+    first.get();
+    second.get();
+    third.get();
+    fourth.get();
+    CHECK(order.size() == 4 && order[0] == 1 && order[1] == 3 && order[2] == 0 && order[3] == 2);
+}
+
+// 优先级老化：等待得足够久的低优先级任务排到新提交的高优先级任务前面，步长较大时则排在后面；
+// 显式截止时间更早的任务总是最先执行
+void testPriorityAging() {
+    struct Case {
+        milliseconds aging;
+        std::vector<int> expected;
+    };
+    for (const Case& test : { Case{ milliseconds(10), { 2, 0, 1 } }, Case{ milliseconds(1000), { 2, 1, 0 } } }) {
+        ThreadPool pool;
+        pool.setQueueMode(QueueMode::QUEUE_PRIORITY);
+        pool.setPriorityAging(test.aging);
+        pool.start(1);
+
+        Gate gate;
+        std::atomic<bool> blocked(false);
+        pool.post([&]() { blocked = true; gate.wait(); });
+        CHECK(eventually([&]() { return blocked.load(); }));
+
+        std::vector<int> order;
+        std::mutex orderMutex;
+        auto record = [&](int value) {
+            std::lock_guard<std::mutex> lock(orderMutex);
+            order.push_back(value);
+        };
+        TaskOptions low, high, due;
+        low.priority = TaskPriority::PRIORITY_LOW;
+        high.priority = TaskPriority::PRIORITY_HIGH;
+        // 虚拟截止时间为提交时间 + 2个步长
+        auto aged = pool.submit(low, record, 0);
+        std::this_thread::sleep_for(milliseconds(40));
+        auto fresh = pool.submit(high, record, 1);
+        due.priority = TaskPriority::PRIORITY_LOW;
+        due.deadline = steady_clock::now() - milliseconds(100);
+        auto overdue = pool.submit(due, record, 2);
+        gate.open();
+        aged.get();
+        fresh.get();
+        overdue.get();
+        CHECK(order == test.expected);
+    }
+}
+
+void testShutdownDiscard() {
+    ThreadPool pool;
+    pool.start(1);
+    Gate gate;
+    std::atomic<bool> blocked(false);
+    pool.post([&]() { blocked = true; gate.wait(); });
+    CHECK(eventually([&]() { return blocked.load(); }));
+
+    auto pending = pool.submit([]() { return 1; });
+    auto result = pool.submitTask(std::make_shared<SumTask>(1, 10));
+    std::thread opener([&]() { std::this_thread::sleep_for(milliseconds(50)); gate.open(); });
+    CHECK(pool.shutdownNow() == 2);
+    opener.join();
+    CHECK_THROWS(pending.get(), std::future_error);
+    CHECK(!result->get().hasValue());
+
+    // 停止后提交失败
+    CHECK(!pool.post([]() {}));
+    auto rejected = pool.submitTask(std::make_shared<SumTask>(1, 10));
+    CHECK(rejected->ready());
+    CHECK(rejected->status() == TaskStatus::STATUS_CANCELLED);
+
+    // 重复启动被忽略：不会重新分配工作队列，也不会覆盖正在运行的控制线程
+    {
+        ThreadPool twice;
+        twice.setMode(PoolMode::MODE_ADAPTIVE);
+        twice.start(2);
+        twice.start(2);
+        CHECK(twice.getTotalThreadSize() == 2);
+        CHECK(twice.submit([]() { return 3; }).get() == 3);
+    }
+
+    // 在工作线程上关闭：不join调用者自己，留给析构函数
+    {
+        ThreadPool self;
+        self.start(2);
+        self.submit([&self]() { self.shutdown(); }).get();
+        CHECK(!self.post([]() {}));
+    }
+}
+
+void testContinuations() {
+    ThreadPool pool;
+    pool.start(2);
+
+    auto text = pool.submit([]() { return 20; })
+                    .then(pool, [](int x) { return x + 1; })
+                    .then(pool, [](int x) { return std::to_string(x * 2); });
+    CHECK(text.get() == "42");
+
+    std::atomic<bool> called(false);
+    auto failed = pool.submit([]() -> int { throw std::runtime_error("upstream"); })
+                      .then(pool, [&](int x) { called = true; return x; });
+    CHECK_THROWS(failed.get(), std::runtime_error);
+    CHECK(!called.load());
+
+    auto fromResult = pool.submitTask(std::make_shared<SumTask>(1, 10))
+                          ->then(pool, [](Any any) { return any.cast<int>() * 2; });
+    CHECK(fromResult.get() == 110);
+}
+
+// 并行算法：结果与串行相同，异常传回调用线程，队列已满时调用线程自己完成所有工作
+void testParallel() {
+    ThreadPool pool;
+    pool.start(4);
+
+    std::vector<std::atomic<int>> visits(1000);
+    parallelFor(pool, 0, 1000, [&](int i) { visits[i]++; });
+    bool once = true;
+    for (auto& visit : visits) {
+        once = once && visit.load() == 1;
+    }
+    CHECK(once);
+
+    std::vector<int> values(500);
+    std::iota(values.begin(), values.end(), 0);
+    parallelFor(pool, values.begin(), values.end(), [](int& value) { value *= 2; }, 16);
+    CHECK(values[0] == 0 && values[499] == 998);
+
+    std::vector<long> squares(values.size());
+    auto end = parallelTransform(pool, values.begin(), values.end(), squares.begin(), [](int value) { return long(value) * value; });
+    CHECK(end == squares.end());
+    bool transformed = true;
+    for (size_t i = 0; i < values.size(); i++) {
+        transformed = transformed && squares[i] == long(values[i]) * values[i];
+    }
+    CHECK(transformed);
+
+    CHECK_THROWS(parallelFor(pool, 0, 1000, [](int i) {
+        if (i == 500) {
+            throw std::runtime_error("parallel");
+        }
+    }), std::runtime_error);
+
+    // 队列已满：辅助任务不投递也不等待空位（默认OVERFLOW_BLOCK会等待1s），调用线程独自完成
+    ThreadPool full;
+    full.setTaskQueueLimit(1);
+    full.start(1);
+    Gate gate;
+    std::atomic<bool> blocked(false);
+    full.post([&]() { blocked = true; gate.wait(); });
+    CHECK(eventually([&]() { return blocked.load(); }));
+    CHECK(full.post([]() {}));
+    std::atomic<int> sum(0);
+    auto start = steady_clock::now();
+    parallelFor(full, 0, 100, [&](int i) { sum += i; });
+    CHECK(steady_clock::now() - start < milliseconds(500));
+    CHECK(sum.load() == 4950);
+    gate.open();
+}
+
+void testTaskGraph() {
+    ThreadPool pool;
+    pool.start(4);
+
+    // 菱形依赖：load -> left/right -> merge
+    std::atomic<int> sequence(0);
+    int loadAt = -1, leftAt = -1, rightAt = -1, mergeAt = -1;
+    TaskGraph graph(pool);
+    auto load = graph.addNode([&]() { loadAt = sequence++; });
+    auto left = graph.addNode([&]() { leftAt = sequence++; });
+    auto right = graph.addNode([&]() { rightAt = sequence++; });
+    auto merge = graph.addNode([&]() { mergeAt = sequence++; });
+    CHECK(graph.addEdge(load, left));
+    CHECK(graph.addEdge(load, right));
+    CHECK(graph.addEdge(left, merge));
+    CHECK(graph.addEdge(right, merge));
+    CHECK(!graph.addEdge(load, 100));
+
+    for (int round = 0; round < 3; round++) {
+        sequence = 0;
+        CHECK(graph.run());
+        graph.wait();
+        CHECK(sequence.load() == 4);
+        CHECK(loadAt == 0 && mergeAt == 3 && leftAt > 0 && rightAt > 0);
+    }
+
+    // 执行期间不能修改或者重新开始
+    Gate gate;
+    TaskGraph blocked(pool);
+    blocked.addNode([&]() { gate.wait(); });
+    CHECK(blocked.run());
+    CHECK(!blocked.ready());
+    CHECK(!blocked.run());
+    CHECK(blocked.addNode([]() {}) == TaskGraph::INVALID_NODE);
+    gate.open();
+    blocked.wait();
+    CHECK(blocked.ready());
+
+    // 第一个异常传给wait()，后继不再执行
+    std::atomic<bool> after(false);
+    TaskGraph failing(pool);
+    auto thrower = failing.addNode([]() { throw std::runtime_error("node"); });
+    auto successor = failing.addNode([&]() { after = true; });
+    failing.addEdge(thrower, successor);
+    CHECK(failing.run());
+    CHECK_THROWS(failing.wait(), std::runtime_error);
+    CHECK(!after.load());
+
+    // 有环的图不能执行
+    TaskGraph cyclic(pool);
+    auto a = cyclic.addNode([]() {});
+    auto b = cyclic.addNode([]() {});
+    cyclic.addEdge(a, b);
+    cyclic.addEdge(b, a);
+    CHECK(!cyclic.run());
+
+    // 析构时等待正在进行的执行
+    std::atomic<int> ran(0);
+    {
+        TaskGraph scoped(pool);
+        auto first = scoped.addNode([&]() { std::this_thread::sleep_for(milliseconds(20)); ran++; });
+        auto second = scoped.addNode([&]() { ran++; });
+        scoped.addEdge(first, second);
+        scoped.run();
+    }
+    CHECK(ran.load() == 2);
+}
+
+// 任务内部等待子任务：固定的少量线程也不会死锁
+long fib(ThreadPool& pool, int n) {
+    if (n < 2) {
+        return n;
+    }
+    auto left = pool.submit(fib, std::ref(pool), n - 1);
+    long right = fib(pool, n - 2);
+    return left.get() + right;
+}
+
+void testWaitInsideTasks() {
+    for (QueueMode queueMode : QUEUE_MODES) {
+        ThreadPool pool;
+        pool.setQueueMode(queueMode);
+        pool.start(2);
+        CHECK(pool.submit(fib, std::ref(pool), 18).get() == 2584);
+    }
+    // 唯一的工作线程阻塞在结果上时，新提交的任务会打断等待，由它执行
+    for (QueueMode queueMode : QUEUE_MODES) {
+        ThreadPool pool;
+        pool.setQueueMode(queueMode);
+        pool.start(1);
+        ThreadPool other;
+        other.start(1);
+        std::atomic<bool> flag(false);
+        std::atomic<bool> waiting(false);
+        auto waiter = pool.submit([&]() {
+            // 结果由另一个线程池完成，而它又要等本线程池执行后提交的任务
+            auto signal = other.submit([&]() {
+                while (!flag.load()) {
+                    std::this_thread::sleep_for(milliseconds(1));
+                }
+                return 7;
+            });
+            waiting = true;
+            return signal.get();
+        });
+        CHECK(eventually([&]() { return waiting.load(); }));
+        std::this_thread::sleep_for(milliseconds(10));
+        pool.post([&]() { flag = true; });
+        CHECK(waiter.waitFor(seconds(2)));
+        CHECK(waiter.get() == 7);
+    }
+}
+
+void testTimers() {
+    ThreadPool pool;
+    pool.start(2);
+
+    std::atomic<bool> once(false);
+    auto start = steady_clock::now();
+    std::atomic<long long> firedAfter(0);
+    TimerHandle single = pool.scheduleAfter(milliseconds(20), [&]() {
+        firedAfter = duration_cast<milliseconds>(steady_clock::now() - start).count();
+        once = true;
+    });
+    CHECK(eventually([&]() { return once.load(); }));
+    CHECK(firedAfter.load() >= 19);
+    CHECK(!single.active());
+    CHECK(!single.cancel());
+
+    std::atomic<int> ticks(0);
+    TimerHandle periodic = pool.scheduleEvery(milliseconds(5), [&]() { ticks++; });
+    CHECK(eventually([&]() { return ticks.load() >= 3; }));
+    CHECK(periodic.active());
+    CHECK(periodic.cancel());
+    int stopped = ticks.load();
+    std::this_thread::sleep_for(milliseconds(50));
+    // cancel返回时可能已经有一次投递到了任务队列
+    CHECK(ticks.load() <= stopped + 1);
+
+    std::atomic<bool> cancelledRan(false);
+    TimerHandle cancelled = pool.scheduleAfter(milliseconds(50), [&]() { cancelledRan = true; });
+    CHECK(cancelled.cancel());
+    std::this_thread::sleep_for(milliseconds(100));
+    CHECK(!cancelledRan.load());
+}
+
+// 到期时队列已满：不按OverflowPolicy在定时线程上执行，也不阻塞定时线程，只跳过这一次
+void testTimerOverflow() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_CACHED);
+    pool.setThreadSizeLimit(1);
+    pool.setTaskQueueLimit(1);
+    pool.setOverflowPolicy(OverflowPolicy::OVERFLOW_CALLER_RUNS);
+    pool.start(1);
+    Gate gate;
+    std::atomic<bool> blocked(false);
+    pool.post([&]() { blocked = true; gate.wait(); });
+    CHECK(eventually([&]() { return blocked.load(); }));
+    CHECK(pool.post([]() {}));
+
+    std::atomic<bool> ranFull(false);
+    pool.scheduleAfter(milliseconds(1), [&]() { ranFull = true; });
+    CHECK(eventually([&]() { return pool.snapshot().rejectedTasks == 1; }));
+    std::this_thread::sleep_for(milliseconds(20));
+    CHECK(!ranFull.load());
+    gate.open();
+
+    // 队列有空位后定时任务照常执行
+    std::atomic<bool> ranLater(false);
+    pool.scheduleAfter(milliseconds(5), [&]() { ranLater = true; });
+    CHECK(eventually([&]() { return ranLater.load(); }));
+    CHECK(!ranFull.load());
+
+    // 周期任务上一次投递的任务还在排队时不再投递，不会占满队列挤掉其他任务
+    ThreadPool slow;
+    slow.setTaskQueueLimit(2);
+    slow.setOverflowPolicy(OverflowPolicy::OVERFLOW_REJECT);
+    slow.start(1);
+    Gate slowGate;
+    std::atomic<bool> slowBlocked(false);
+    slow.post([&]() { slowBlocked = true; slowGate.wait(); });
+    CHECK(eventually([&]() { return slowBlocked.load(); }));
+    std::atomic<int> ticks(0);
+    TimerHandle periodic = slow.scheduleEvery(milliseconds(2), [&]() { ticks++; });
+    std::this_thread::sleep_for(milliseconds(30));
+    CHECK(slow.snapshot().queuedTasks == 1);
+    CHECK(slow.post([]() {}));
+    slowGate.open();
+    CHECK(eventually([&]() { return ticks.load() >= 2; }));
+    CHECK(periodic.cancel());
+}
+
+void testCancellation() {
+    ThreadPool pool;
+    pool.start(1);
+
+    // 排队中的任务被取消后不再执行
+    Gate gate;
+    std::atomic<bool> blocked(false);
+    pool.post([&]() { blocked = true; gate.wait(); });
+    CHECK(eventually([&]() { return blocked.load(); }));
+
+    CancellationSource source;
+    TaskOptions withToken;
+    withToken.token = source.token();
+    std::atomic<bool> ran(false);
+    auto cancelled = pool.submit(withToken, [&]() { ran = true; return 1; });
+    auto cancelledResult = pool.submitTask(std::make_shared<SumTask>(1, 10), withToken);
+
+    TaskOptions expiring;
+    expiring.expireAt = steady_clock::now() + milliseconds(10);
+    auto expired = pool.submit(expiring, []() { return 2; });
+    auto untouched = pool.submit([]() { return 3; });
+
+    source.cancel();
+    std::this_thread::sleep_for(milliseconds(30));
+    gate.open();
+
+    CHECK_THROWS(cancelled.get(), TaskCancelledError);
+    CHECK(!ran.load());
+    CHECK(cancelledResult->get().hasValue() == false);
+    CHECK(cancelledResult->status() == TaskStatus::STATUS_CANCELLED);
+    CHECK(expired.waitFor(seconds(2)));
+    CHECK(expired.status() == TaskStatus::STATUS_EXPIRED);
+    CHECK_THROWS(expired.get(), TaskCancelledError);
+    CHECK(untouched.get() == 3);
+
+    PoolMetrics metrics = pool.snapshot();
+    CHECK(metrics.cancelledTasks == 2);
+    CHECK(metrics.expiredTasks == 1);
+
+    // 正在执行的任务通过CancellationToken::current()轮询
+    CancellationSource running;
+    TaskOptions pollOptions;
+    pollOptions.token = running.token();
+    std::atomic<bool> started(false);
+    auto polling = pool.submit(pollOptions, [&]() {
+        started = true;
+        while (!CancellationToken::current().cancelled()) {
+            std::this_thread::sleep_for(milliseconds(1));
+        }
+        return true;
+    });
+    CHECK(eventually([&]() { return started.load(); }));
+    running.cancel();
+    CHECK(polling.get());
+}
+
+void testOverflowPolicies() {
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.setThreadSizeLimit(1);
+        pool.setTaskQueueLimit(2);
+        pool.setOverflowPolicy(OverflowPolicy::OVERFLOW_REJECT);
+        pool.start(1);
+        Gate gate;
+        std::atomic<bool> blocked(false);
+        pool.post([&]() { blocked = true; gate.wait(); });
+        CHECK(eventually([&]() { return blocked.load(); }));
+        CHECK(pool.post([]() {}));
+        CHECK(pool.post([]() {}));
+        CHECK(!pool.post([]() {}));
+        // 提交失败的TaskFuture视为已经取消，不会访问空的共享状态
+        auto failed = pool.trySubmit([]() { return 1; });
+        CHECK(!failed.valid());
+        CHECK(failed.ready());
+        CHECK(failed.status() == TaskStatus::STATUS_CANCELLED);
+        CHECK(failed.waitFor(milliseconds(0)));
+        failed.wait();
+        CHECK(!failed.onReady([]() {}));
+        CHECK(!failed.then(pool, [](int v) { return v; }).valid());
+        CHECK_THROWS(failed.get(), TaskCancelledError);
+        gate.open();
+        pool.shutdown();
+        CHECK(pool.snapshot().rejectedTasks == 2);
+    }
+    {
+        // 队列上限在默认的Fixed模式下同样生效
+        ThreadPool pool;
+        pool.setTaskQueueLimit(1);
+        pool.setOverflowPolicy(OverflowPolicy::OVERFLOW_REJECT);
+        pool.start(1);
+        Gate gate;
+        std::atomic<bool> blocked(false);
+        pool.post([&]() { blocked = true; gate.wait(); });
+        CHECK(eventually([&]() { return blocked.load(); }));
+        CHECK(pool.post([]() {}));
+        CHECK(!pool.post([]() {}));
+        gate.open();
+    }
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.setThreadSizeLimit(1);
+        pool.setTaskQueueLimit(1);
+        pool.setOverflowPolicy(OverflowPolicy::OVERFLOW_CALLER_RUNS);
+        pool.start(1);
+        Gate gate;
+        std::atomic<bool> blocked(false);
+        pool.post([&]() { blocked = true; gate.wait(); });
+        CHECK(eventually([&]() { return blocked.load(); }));
+        CHECK(pool.post([]() {}));
+        std::thread::id runner;
+        CHECK(pool.post([&]() { runner = std::this_thread::get_id(); }));
+        CHECK(runner == std::this_thread::get_id());
+        gate.open();
+    }
+    // OVERFLOW_DROP_OLDEST：共享队列挤出最早的任务，优先级队列挤出最不紧急的任务
+    for (QueueMode queueMode : { QueueMode::QUEUE_SHARED, QueueMode::QUEUE_PRIORITY }) {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.setThreadSizeLimit(1);
+        pool.setQueueMode(queueMode);
+        pool.setTaskQueueLimit(4);
+        pool.setOverflowPolicy(OverflowPolicy::OVERFLOW_DROP_OLDEST);
+        pool.start(1);
+        Gate gate;
+        std::atomic<bool> blocked(false);
+        pool.post([&]() { blocked = true; gate.wait(); });
+        CHECK(eventually([&]() { return blocked.load(); }));
+        std::vector<int> order;
+        std::mutex orderMutex;
+        const TaskPriority priorities[] = {
+            TaskPriority::PRIORITY_NORMAL, TaskPriority::PRIORITY_LOW, TaskPriority::PRIORITY_HIGH,
+            TaskPriority::PRIORITY_NORMAL, TaskPriority::PRIORITY_HIGH, TaskPriority::PRIORITY_LOW
+        };
+        for (int i = 0; i < 6; i++) {
+            TaskOptions options;
+            options.priority = priorities[i];
+            CHECK(pool.post([&, i]() { std::lock_guard<std::mutex> lock(orderMutex); order.push_back(i); }, options));
+        }
+        gate.open();
+        pool.shutdown();
+        CHECK(pool.snapshot().droppedTasks == 2);
+        std::vector<int> expected = QueueMode::QUEUE_PRIORITY == queueMode
+            ? std::vector<int>{ 2, 4, 0, 5 } : std::vector<int>{ 2, 3, 4, 5 };
+        CHECK(order == expected);
+    }
+    // 队列上限为0时没有可以挤出的任务，提交失败而不是访问空队列
+    for (QueueMode queueMode : { QueueMode::QUEUE_SHARED, QueueMode::QUEUE_PRIORITY }) {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.setQueueMode(queueMode);
+        pool.setTaskQueueLimit(0);
+        pool.setOverflowPolicy(OverflowPolicy::OVERFLOW_DROP_OLDEST);
+        pool.start(1);
+        CHECK(!pool.post([]() {}));
+        CHECK(pool.snapshot().rejectedTasks == 1);
+    }
+}
+
+// 水位线通知交替出现；callback不持有锁，可以在其中提交任务
+void testWatermarks() {
+    for (QueueMode queueMode : QUEUE_MODES) {
+        std::vector<QueueWatermark> marks;
+        std::mutex marksMutex;
+        std::atomic<int> refills(0);
+        std::atomic<int> executed(0);
+        ThreadPool pool;
+        pool.setQueueMode(queueMode);
+        pool.setQueueWatermarks(3, 2, [&](QueueWatermark mark, size_t) {
+            {
+                std::lock_guard<std::mutex> lock(marksMutex);
+                marks.push_back(mark);
+            }
+            // 回落到低水位时再补充三个任务，重新越过高水位
+            if (QueueWatermark::WATERMARK_LOW == mark && refills.fetch_add(1) < 3) {
+                for (int i = 0; i < 3; i++) {
+                    pool.post([&]() { executed++; });
+                }
+            }
+        });
+        pool.start(1);
+        Gate gate;
+        std::atomic<bool> blocked(false);
+        pool.post([&]() { blocked = true; gate.wait(); });
+        CHECK(eventually([&]() { return blocked.load(); }));
+        for (int i = 0; i < 3; i++) {
+            pool.post([&]() { executed++; });
+        }
+        gate.open();
+        CHECK(eventually([&]() { return executed.load() == 12; }));
+        pool.shutdown();
+
+        std::lock_guard<std::mutex> lock(marksMutex);
+        CHECK(marks.size() == 8);
+        for (size_t i = 0; i < marks.size(); i++) {
+            CHECK(marks[i] == (i % 2 == 0 ? QueueWatermark::WATERMARK_HIGH : QueueWatermark::WATERMARK_LOW));
+        }
+    }
+}
+
+// 同一个key的任务按提交顺序串行执行，不同key之间并行
+void testStrands() {
+    ThreadPool pool;
+    pool.setQueueMode(QueueMode::QUEUE_WORK_STEALING);
+    pool.start(4);
+
+    const int KEYS = 8, PER_KEY = 500;
+    std::vector<std::vector<int>> seen(KEYS);
+    std::vector<std::atomic<int>> inside(KEYS);
+    std::atomic<bool> overlapped(false);
+    {
+        StrandExecutor<int> strand(pool);
+        for (int i = 0; i < PER_KEY; i++) {
+            for (int key = 0; key < KEYS; key++) {
+                CHECK(strand.post(key, [&, key, i]() {
+                    if (inside[key]++ != 0) {
+                        overlapped = true;
+                    }
+                    seen[key].push_back(i);
+                    inside[key]--;
+                }));
+            }
+        }
+        strand.wait();
+        CHECK(strand.activeKeys() == 0);
+
+        auto value = strand.submit(1, [](int x) { return x + 1; }, 41);
+        CHECK(value.get() == 42);
+        auto failed = strand.submit(1, []() -> int { throw std::runtime_error("strand"); });
+        CHECK_THROWS(failed.get(), std::runtime_error);
+        // 前一个任务的异常不影响同一个key后面的任务
+        CHECK(strand.submit(1, []() { return 7; }).get() == 7);
+    }
+    CHECK(!overlapped.load());
+    for (int key = 0; key < KEYS; key++) {
+        std::vector<int> expected(PER_KEY);
+        std::iota(expected.begin(), expected.end(), 0);
+        CHECK(seen[key] == expected);
+    }
+
+    // 连续执行DRAIN_BATCH_LIMIT个任务后重新投递失败或者会在当前线程上执行时，继续在当前栈帧中排空，
+    // 不丢弃排队的任务，也不递归。每个任务都往线程池投递一个空任务，让队列在重新投递时保持已满
+    for (OverflowPolicy policy : { OverflowPolicy::OVERFLOW_REJECT, OverflowPolicy::OVERFLOW_CALLER_RUNS }) {
+        ThreadPool busy;
+        busy.setTaskQueueLimit(1);
+        busy.setOverflowPolicy(policy);
+        busy.start(1);
+
+        const int TASKS = static_cast<int>(StrandExecutor<int>::DRAIN_BATCH_LIMIT) * 20;
+        std::vector<int> order;
+        uintptr_t lowest = UINTPTR_MAX, highest = 0;
+        StrandExecutor<int> strand(busy);
+        // 每个任务执行时才追加下一个任务，排空任务每轮只取到一个，连续执行满DRAIN_BATCH_LIMIT个后重新投递
+        std::function<void(int)> step = [&](int i) {
+            char marker;
+            uintptr_t address = reinterpret_cast<uintptr_t>(&marker);
+            lowest = std::min(lowest, address);
+            highest = std::max(highest, address);
+            order.push_back(i);
+            busy.post([]() {});
+            if (i + 1 < TASKS) {
+                strand.post(0, [&step, i]() { step(i + 1); });
+            }
+        };
+        CHECK(strand.post(0, [&step]() { step(0); }));
+        strand.wait();
+        std::vector<int> expected(TASKS);
+        std::iota(expected.begin(), expected.end(), 0);
+        CHECK(order == expected);
+        CHECK(highest - lowest < 1024);
+    }
+
+    // 排空任务被丢弃时，这个key排队的任务也被丢弃，future得到broken_promise
+    ThreadPool stopped;
+    stopped.start(1);
+    stopped.shutdown();
+    StrandExecutor<std::string> strand(stopped);
+    auto discarded = strand.submit("key", []() { return 1; });
+    CHECK_THROWS(discarded.get(), std::future_error);
+    CHECK(!strand.post("key", []() {}));
+    CHECK(strand.activeKeys() == 0);
+}
+
+void testExecutorGroup() {
+    ExecutorGroup group(2, 4);
+    CHECK(group.capacity(LaneKind::LANE_CPU) == 2);
+    CHECK(group.capacity(LaneKind::LANE_BLOCKING) == 4);
+
+    LaneOptions cpuOptions;
+    cpuOptions.minThreads = 2;
+    ThreadPool* cpu = group.addLane("cpu", cpuOptions);
+    CHECK(cpu != nullptr);
+    CHECK(group.lane("cpu") == cpu);
+    CHECK(group.lane("missing") == nullptr);
+    CHECK(group.addLane("cpu", cpuOptions) == nullptr);
+
+    // CPU容量已经全部被保证出去
+    LaneOptions extra;
+    CHECK(group.addLane("extra", extra) == nullptr);
+
+    LaneOptions ioOptions;
+    ioOptions.kind = LaneKind::LANE_BLOCKING;
+    ioOptions.mode = PoolMode::MODE_CACHED;
+    ioOptions.minThreads = 1;
+    ioOptions.idleTimeout = milliseconds(50);
+    ThreadPool* io = group.addLane("io", ioOptions);
+    CHECK(io != nullptr);
+    // 为另一个阻塞通道保证一个线程，io通道最多只能借到4 - 1 - 1 = 2个
+    LaneOptions dbOptions;
+    dbOptions.kind = LaneKind::LANE_BLOCKING;
+    CHECK(group.addLane("db", dbOptions) != nullptr);
+
+    CHECK(cpu->submit([]() { return 1; }).get() == 1);
+
+    // Fixed模式的通道同样使用queueLimit
+    ExecutorGroup limited(1, 1);
+    LaneOptions fixedOptions;
+    fixedOptions.queueLimit = 2;
+    fixedOptions.overflowPolicy = OverflowPolicy::OVERFLOW_REJECT;
+    ThreadPool* fixed = limited.addLane("fixed", fixedOptions);
+    CHECK(fixed != nullptr);
+    Gate fixedGate;
+    std::atomic<bool> fixedBlocked(false);
+    fixed->post([&]() { fixedBlocked = true; fixedGate.wait(); });
+    CHECK(eventually([&]() { return fixedBlocked.load(); }));
+    CHECK(fixed->post([]() {}));
+    CHECK(fixed->post([]() {}));
+    CHECK(!fixed->post([]() {}));
+    fixedGate.open();
+
+    // 阻塞通道借用容量增长，不会占用其他通道保证的部分
+    Gate gate;
+    std::atomic<int> running(0);
+    std::vector<TaskFuture<void>> waits;
+    for (int i = 0; i < 6; i++) {
+        waits.push_back(io->submit([&]() { running++; gate.wait(); }));
+    }
+    CHECK(eventually([&]() { return running.load() == 3; }));
+    std::this_thread::sleep_for(milliseconds(20));
+    CHECK(running.load() == 3);
+    std::vector<LaneUsage> usage = group.usage();
+    CHECK(usage.size() == 3);
+    CHECK(usage[0].name == "cpu" && usage[0].threads == 2 && usage[0].borrowed == 0);
+    CHECK(usage[1].name == "io" && usage[1].threads == 3 && usage[1].borrowed == 2);
+    CHECK(usage[1].denied > 0);
+    CHECK(usage[2].name == "db" && usage[2].threads == 1);
+    CHECK(group.lane("db")->submit([]() { return 2; }).get() == 2);
+    gate.open();
+    for (auto& wait : waits) {
+        wait.get();
+    }
+    // 借用的线程空闲idleTimeout后退出，归还容量
+    CHECK(eventually([&]() { return group.usage()[1].borrowed == 0; }));
+    CHECK(group.usage()[1].threads == 1);
+
+    group.shutdown();
+    CHECK(!cpu->post([]() {}));
+}
+
+// 线程缓存析构之后才释放内存块的thread_local对象：它先于线程缓存构造，所以在线程缓存之后析构
+struct LateFree {
+    ~LateFree() {
+        for (void* block : blocks) {
+            detail::BlockPool::deallocate(block, 32);
+        }
+    }
+    std::vector<void*> blocks;
+};
+
+void testBlockPool() {
+#ifndef THREAD_POOL_NO_BLOCK_POOL
+    const size_t BLOCKS = 8192;
+    uint64_t released = detail::BlockPool::stats().releasedBlocks;
+
+    // 突发分配之后全部释放：共享链表超过上限的部分归还给全局分配器
+    std::thread burst([&]() {
+        std::vector<void*> blocks;
+        for (size_t i = 0; i < BLOCKS; i++) {
+            blocks.push_back(detail::BlockPool::allocate(32));
+        }
+        for (void* block : blocks) {
+            detail::BlockPool::deallocate(block, 32);
+        }
+    });
+    burst.join();
+    AllocationStats stats = detail::BlockPool::stats();
+    CHECK(stats.releasedBlocks > released);
+    CHECK(stats.cachedBlocks < BLOCKS);
+
+    // 线程缓存析构之后逐个释放的块同样受上限约束
+    released = stats.releasedBlocks;
+    std::thread late([&]() {
+        thread_local LateFree holder;
+        for (size_t i = 0; i < BLOCKS; i++) {
+            holder.blocks.push_back(detail::BlockPool::allocate(32));
+        }
+    });
+    late.join();
+    stats = detail::BlockPool::stats();
+    CHECK(stats.releasedBlocks > released);
+    CHECK(stats.cachedBlocks < BLOCKS);
+#endif
+}
+
+#ifdef __cpp_impl_coroutine
+CoTask<int> addOnWorker(ThreadPool& pool, int a, int b) {
+    co_await pool.schedule();
+    int left = co_await pool.submit([a]() { return a; });
+    Any right = co_await pool.submitTask(std::make_shared<SumTask>(b, b));
+    co_return left + right.cast<int>();
+}
+
+CoTask<std::thread::id> hop(ThreadPool& pool, TaskOptions options = TaskOptions()) {
+    co_await pool.schedule(options);
+    co_return std::this_thread::get_id();
+}
+
+CoTask<void> fail() {
+    throw std::runtime_error("coroutine");
+    co_return;
+}
+
+CoTask<int> nested(ThreadPool& pool) {
+    int sum = 0;
+    for (int i = 0; i < 10; i++) {
+        sum += co_await addOnWorker(pool, i, 1);
+    }
+    co_return sum;
+}
+
+CoTask<int> awaitFuture(TaskFuture<int> future) {
+    co_return co_await std::move(future);
+}
+
+void testCoroutines() {
+    ThreadPool pool;
+    pool.start(2);
+
+    CHECK(spawn(pool, addOnWorker(pool, 40, 2)).get() == 42);
+    CHECK(spawn(pool, nested(pool)).get() == 55);
+    CHECK(spawn(pool, hop(pool)).get() != std::this_thread::get_id());
+    CHECK_THROWS(spawn(pool, fail()).get(), std::runtime_error);
+    // 等待无效的TaskFuture不会挂起，co_await抛出TaskCancelledError
+    CHECK_THROWS(spawn(pool, awaitFuture(TaskFuture<int>())).get(), TaskCancelledError);
+
+    // 恢复任务因为令牌取消、过期而被跳过时，co_await抛出TaskCancelledError
+    CancellationSource source;
+    source.cancel();
+    TaskOptions cancelled;
+    cancelled.token = source.token();
+    auto skipped = spawn(pool, hop(pool, cancelled));
+    CHECK(skipped.waitFor(seconds(2)));
+    CHECK_THROWS(skipped.get(), TaskCancelledError);
+
+    ThreadPool other;
+    other.start(1);
+    Gate gate;
+    std::atomic<bool> blocked(false);
+    other.post([&]() { blocked = true; gate.wait(); });
+    CHECK(eventually([&]() { return blocked.load(); }));
+    TaskOptions expiring;
+    expiring.expireAt = steady_clock::now() + milliseconds(10);
+    auto expired = spawn(pool, hop(other, expiring));
+    std::this_thread::sleep_for(milliseconds(30));
+    gate.open();
+    CHECK(expired.waitFor(seconds(2)));
+    try {
+        expired.get();
+        CHECK(false && "expired schedule() resumes normally");
+    } catch (const TaskCancelledError& e) {
+        CHECK(e.status() == TaskStatus::STATUS_EXPIRED);
+    }
+
+    // 关闭线程池时被丢弃的恢复任务同样恢复协程，协程帧不会泄漏
+    Gate stopGate;
+    std::atomic<bool> stopBlocked(false);
+    other.post([&]() { stopBlocked = true; stopGate.wait(); });
+    CHECK(eventually([&]() { return stopBlocked.load(); }));
+    auto dropped = spawn(pool, hop(other));
+    std::this_thread::sleep_for(milliseconds(20));
+    std::thread opener([&]() { std::this_thread::sleep_for(milliseconds(50)); stopGate.open(); });
+    other.shutdownNow();
+    opener.join();
+    CHECK(dropped.waitFor(seconds(2)));
+    CHECK_THROWS(dropped.get(), TaskCancelledError);
+}
+#endif
+
+struct TestCase {
+    const char* name;
+    void (*func)();
+};
+
+const TestCase TESTS[] = {
+    { "submit_future", testSubmitFuture },
+    { "queue_modes", testQueueModes },
+    { "affinity", testAffinity },
+    { "adaptive_mode", testAdaptiveMode },
+    { "idle_spin", testIdleSpin },
+    { "latency_histograms", testLatencyHistograms },
+    { "priority_order", testPriorityOrder },
+    { "priority_aging", testPriorityAging },
+    { "shutdown_discard", testShutdownDiscard },
+    { "continuations", testContinuations },
+    { "parallel", testParallel },
+    { "task_graph", testTaskGraph },
+    { "wait_inside_tasks", testWaitInsideTasks },
+    { "timers", testTimers },
+    { "timer_overflow", testTimerOverflow },
+    { "cancellation", testCancellation },
+    { "overflow_policies", testOverflowPolicies },
+    { "watermarks", testWatermarks },
+    { "strands", testStrands },
+    { "executor_group", testExecutorGroup },
+    { "block_pool", testBlockPool },
+#ifdef __cpp_impl_coroutine
+    { "coroutines", testCoroutines },
+#endif
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int run = 0;
+    for (const TestCase& test : TESTS) {
+        if (argc > 1 && std::strcmp(argv[1], test.name) != 0) {
+            continue;
+        }
+        int before = failures;
+        test.func();
+        run++;
+        std::cout << (failures == before ? "[PASS] " : "[FAIL] ") << test.name << std::endl;
+    }
+    if (run == 0) {
+        std::cerr << "No test named " << argv[1] << std::endl;
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,328 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <iostream>
+
+/*
+    这里是时间轮和定时线程的实现代码
+*/
+
+namespace {
+
+// 最低位的1所在的位置，bits不能为0
+int lowestBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+} // namespace
+
+TimerWheel::TimerWheel(uint64_t now) : m_current(now), m_size(0) {
+    std::fill(std::begin(m_heads), std::end(m_heads), nullptr);
+    std::fill(std::begin(m_bitmaps), std::end(m_bitmaps), 0);
+}
+
+void TimerWheel::add(TimerEntry* entry) {
+    if (entry->expire <= m_current) {
+        link(entry, DUE_SLOT);
+        return;
+    }
+    // 放在与当前tick处于同一个上层区间的最低一层
+    for (int level = 0; level < LEVELS; level++) {
+        int shift = SLOT_BITS * (level + 1);
+        if ((entry->expire >> shift) == (m_current >> shift)) {
+            int index = static_cast<int>((entry->expire >> (SLOT_BITS * level)) & (SLOTS - 1));
+            link(entry, level * SLOTS + index);
+            return;
+        }
+    }
+    link(entry, OVERFLOW_SLOT);
+}
+
+void TimerWheel::remove(TimerEntry* entry) {
+    if (entry->slot >= 0) {
+        unlink(entry);
+    }
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<TimerEntry*>& due) {
+    for (;;) {
+        for (TimerEntry* entry = take(DUE_SLOT); entry; ) {
+            TimerEntry* next = entry->next;
+            due.push_back(entry);
+            entry = next;
+        }
+        uint64_t next = nextTick();
+        if (next == NO_TICK || next > now) {
+            break;
+        }
+        // 中间的tick上没有需要处理的槽位，直接跳过
+        m_current = next;
+        processTick(due);
+    }
+    m_current = std::max(m_current, now);
+}
+
+uint64_t TimerWheel::nextTick() const {
+    if (m_heads[DUE_SLOT]) {
+        return m_current;
+    }
+    uint64_t next = NO_TICK;
+    for (int level = 0; level < LEVELS; level++) {
+        int shift = SLOT_BITS * level;
+        uint64_t unit = m_current >> shift;
+        int index = static_cast<int>(unit & (SLOTS - 1));
+        // 同一层的定时器都在当前这一圈内，只需要看当前槽位之后的部分
+        uint64_t ahead = index == SLOTS - 1 ? 0 : m_bitmaps[level] & (~0ULL << (index + 1));
+        if (ahead) {
+            uint64_t tick = ((unit & ~static_cast<uint64_t>(SLOTS - 1)) + lowestBit(ahead)) << shift;
+            next = std::min(next, tick);
+        }
+    }
+    if (m_heads[OVERFLOW_SLOT]) {
+        int shift = SLOT_BITS * LEVELS;
+        next = std::min(next, ((m_current >> shift) + 1) << shift);
+    }
+    return next;
+}
+
+void TimerWheel::clear(std::vector<TimerEntry*>& entries) {
+    for (int slot = 0; slot <= DUE_SLOT; slot++) {
+        for (TimerEntry* entry = take(slot); entry; ) {
+            TimerEntry* next = entry->next;
+            entries.push_back(entry);
+            entry = next;
+        }
+    }
+}
+
+void TimerWheel::link(TimerEntry* entry, int slot) {
+    entry->slot = slot;
+    entry->prev = nullptr;
+    entry->next = m_heads[slot];
+    if (entry->next) {
+        entry->next->prev = entry;
+    }
+    m_heads[slot] = entry;
+    if (slot < OVERFLOW_SLOT) {
+        m_bitmaps[slot / SLOTS] |= 1ULL << (slot % SLOTS);
+    }
+    m_size++;
+}
+
+void TimerWheel::unlink(TimerEntry* entry) {
+    int slot = entry->slot;
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        m_heads[slot] = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    if (!m_heads[slot] && slot < OVERFLOW_SLOT) {
+        m_bitmaps[slot / SLOTS] &= ~(1ULL << (slot % SLOTS));
+    }
+    entry->prev = entry->next = nullptr;
+    entry->slot = -1;
+    m_size--;
+}
+
+// 返回的链表仍然通过next相连，但条目已经不属于时间轮
+TimerEntry* TimerWheel::take(int slot) {
+    TimerEntry* head = m_heads[slot];
+    m_heads[slot] = nullptr;
+    if (slot < OVERFLOW_SLOT) {
+        m_bitmaps[slot / SLOTS] &= ~(1ULL << (slot % SLOTS));
+    }
+    for (TimerEntry* entry = head; entry; entry = entry->next) {
+        entry->slot = -1;
+        entry->prev = nullptr;
+        m_size--;
+    }
+    return head;
+}
+
+void TimerWheel::processTick(std::vector<TimerEntry*>& due) {
+    auto reinsert = [this](TimerEntry* entry) {
+        while (entry) {
+            TimerEntry* next = entry->next;
+            add(entry);
+            entry = next;
+        }
+    };
+    // 从高层到低层，下放所有以当前tick为区间起点的槽位，下放后已经到期的条目进入到期链表
+    if ((m_current & ((1ULL << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+        reinsert(take(OVERFLOW_SLOT));
+    }
+    for (int level = LEVELS - 1; level > 0; level--) {
+        int shift = SLOT_BITS * level;
+        if (m_current & ((1ULL << shift) - 1)) {
+            continue;
+        }
+        int index = static_cast<int>((m_current >> shift) & (SLOTS - 1));
+        reinsert(take(level * SLOTS + index));
+    }
+    for (TimerEntry* entry = take(static_cast<int>(m_current & (SLOTS - 1))); entry; ) {
+        TimerEntry* next = entry->next;
+        due.push_back(entry);
+        entry = next;
+    }
+}
+
+namespace detail {
+
+TimerQueue::TimerQueue(ThreadPool& pool)
+    : m_pool(pool), m_base(std::chrono::steady_clock::now()), m_wheel(0), m_running(false), m_stopped(false) {}
+
+TimerQueue::~TimerQueue() {
+    stop();
+}
+
+void TimerQueue::add(const std::shared_ptr<TimerState>& state, std::chrono::steady_clock::time_point when) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopped) {
+        state->cancelled = true;
+        return;
+    }
+    if (!m_running) {
+        // 第一个定时任务到来时才创建定时线程
+        m_running = true;
+        m_thread = std::thread(&TimerQueue::timerFunc, this);
+    }
+    state->expire = toTick(when);
+    state->self = state;
+    bool earlier = state->expire < m_wheel.nextTick();
+    m_wheel.add(state.get());
+    if (earlier) {
+        m_cv.notify_one();
+    }
+}
+
+bool TimerQueue::cancel(TimerState* state) {
+    std::shared_ptr<TimerState> self;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (state->cancelled.exchange(true)) {
+        return false;
+    }
+    if (state->slot < 0) {
+        return false; // 一次性任务已经到期
+    }
+    m_wheel.remove(state);
+    self = std::move(state->self); // 在解锁之后释放
+    return true;
+}
+
+void TimerQueue::stop() {
+    std::vector<TimerEntry*> entries;
+    std::vector<std::shared_ptr<TimerState>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopped) {
+            return;
+        }
+        m_stopped = true;
+        m_wheel.clear(entries);
+        for (TimerEntry* entry : entries) {
+            TimerState* state = static_cast<TimerState*>(entry);
+            state->cancelled = true;
+            dropped.push_back(std::move(state->self));
+        }
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+uint64_t TimerQueue::toTick(std::chrono::steady_clock::time_point when) const {
+    if (when <= m_base) {
+        return 0;
+    }
+    return toTicks(when - m_base);
+}
+
+uint64_t TimerQueue::toTicks(std::chrono::steady_clock::duration duration) const {
+    auto ticks = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+    if (ticks < duration) {
+        ticks += std::chrono::milliseconds(1);
+    }
+    return static_cast<uint64_t>(std::max<std::chrono::milliseconds::rep>(ticks.count(), 0));
+}
+
+void TimerQueue::timerFunc() {
+    std::vector<TimerEntry*> due;
+    std::vector<std::shared_ptr<TimerState>> fired;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopped) {
+        auto elapsed = std::chrono::steady_clock::now() - m_base;
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+        due.clear();
+        m_wheel.advance(now, due);
+        for (TimerEntry* entry : due) {
+            TimerState* state = static_cast<TimerState*>(entry);
+            std::shared_ptr<TimerState> self = std::move(state->self);
+            if (state->period > 0) {
+                // 周期任务按固定频率重新插入，落后太多时从现在重新开始计时，不补执行
+                state->expire += state->period;
+                if (state->expire <= now) {
+                    state->expire = now + state->period;
+                }
+                state->self = self;
+                m_wheel.add(state);
+            } else {
+                state->fired = true;
+            }
+            fired.push_back(std::move(self));
+        }
+
+        // 投递任务时不持有定时器的锁
+        lock.unlock();
+        for (auto& state : fired) {
+            fire(state);
+        }
+        fired.clear();
+        lock.lock();
+
+        if (m_stopped) {
+            break;
+        }
+        uint64_t next = m_wheel.nextTick();
+        if (next == TimerWheel::NO_TICK) {
+            m_cv.wait(lock);
+        } else {
+            m_cv.wait_until(lock, m_base + std::chrono::milliseconds(next));
+        }
+    }
+}
+
+// 不受OverflowPolicy影响：定时线程不能在队列已满时阻塞，也不能自己执行任务，否则所有定时器都会被拖后
+// 队列已满时这一次被跳过，记入PoolMetrics::rejectedTasks，周期任务在下一个周期照常投递
+// 周期任务上一次投递的任务还在排队或者执行时，在投递之前就跳过这一次，不占用队列的空位
+void TimerQueue::fire(const std::shared_ptr<TimerState>& state) {
+    if (state->cancelled || state->running.exchange(true)) {
+        return;
+    }
+    bool queued = m_pool.enqueueJobFor(Job([ref = state]() {
+        if (!ref->cancelled) {
+            try {
+                ref->job();
+            } catch (...) {
+                std::cerr << "Timer task threw an exception." << std::endl;
+            }
+        }
+        ref->running = false;
+    }), TaskOptions(), std::chrono::steady_clock::duration::zero());
+    if (!queued) {
+        state->running = false;
+    }
+}
+
+} // namespace detail
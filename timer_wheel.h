@@ -0,0 +1,128 @@
+#ifndef __TIMER_WHEEL_H
+#define __TIMER_WHEEL_H
+
+#include "thread_pool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    分层时间轮：5层，每层64个槽位，tick为1ms，覆盖2^30ms（约12天），更远的定时器放在溢出链表中。
+    定时器按照与当前tick所在的上层区间是否相同决定放在哪一层，因此同一层中的定时器都在当前这一圈内，
+    每个槽位恰好在对应区间开始时被处理一次：高层槽位下放到低层，第0层槽位直接到期。
+    插入、删除都是O(1)；每层一个64位的位图记录非空槽位，空闲时可以直接跳到下一个需要处理的tick，
+    等待中的定时器不消耗CPU。
+*/
+
+// 时间轮中的条目，以侵入式双向链表挂在槽位上
+struct TimerEntry {
+    TimerEntry() : expire(0), prev(nullptr), next(nullptr), slot(-1) {}
+
+    uint64_t expire;   // 到期的tick
+    TimerEntry* prev;
+    TimerEntry* next;
+    int slot;          // 所在的链表，-1表示不在时间轮中
+};
+
+// 时间轮本身不加锁，由调用者负责同步
+class TimerWheel {
+public:
+    static const int LEVELS = 5;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const uint64_t NO_TICK = UINT64_MAX;
+
+    explicit TimerWheel(uint64_t now = 0);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel &operator = (const TimerWheel&) = delete;
+
+    // 按entry->expire插入，已经到期的条目在下一次advance时返回
+    void add(TimerEntry* entry);
+    // 从时间轮中删除，不在时间轮中时什么也不做
+    void remove(TimerEntry* entry);
+    // 推进到now，把到期的条目按到期顺序追加到due中
+    void advance(uint64_t now, std::vector<TimerEntry*>& due);
+    // 下一个需要处理的tick（到期或者下放），没有定时器时返回NO_TICK
+    uint64_t nextTick() const;
+    // 取出所有条目
+    void clear(std::vector<TimerEntry*>& entries);
+
+    uint64_t currentTick() const {
+        return m_current;
+    }
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+    static const int OVERFLOW_SLOT = LEVELS * SLOTS;
+    static const int DUE_SLOT = OVERFLOW_SLOT + 1;
+
+    void link(TimerEntry* entry, int slot);
+    void unlink(TimerEntry* entry);
+    // 取出整个槽位的链表
+    TimerEntry* take(int slot);
+    // 在tick为m_current时处理所有到达区间起点的槽位
+    void processTick(std::vector<TimerEntry*>& due);
+
+    uint64_t m_current;
+    size_t m_size;
+    TimerEntry* m_heads[DUE_SLOT + 1];
+    uint64_t m_bitmaps[LEVELS]; // 每层非空槽位的位图
+};
+
+namespace detail {
+
+// 一个定时任务：到期时把任务投递到线程池，周期任务随后重新插入时间轮
+struct TimerState : TimerEntry {
+    TimerState() : period(0), cancelled(false), fired(false), running(false) {}
+
+    std::shared_ptr<TimerState> self; // 在时间轮中时保持自身存活
+    Job job;
+    uint64_t period;                  // 周期（tick），0表示只执行一次
+    std::atomic<bool> cancelled;
+    std::atomic<bool> fired;          // 一次性任务已经到期
+    std::atomic<bool> running;        // 已经投递、还没有执行完；周期任务此时跳过本次
+};
+
+// 线程池的定时器服务：一个时间轮加一个定时线程，没有定时器时定时线程一直睡眠
+class TimerQueue {
+public:
+    explicit TimerQueue(ThreadPool& pool);
+    ~TimerQueue();
+
+    // 插入定时任务，第一次调用时启动定时线程
+    void add(const std::shared_ptr<TimerState>& state, std::chrono::steady_clock::time_point when);
+    // 取消定时任务，返回任务是否还在时间轮中等待；已经到期但还没开始执行的那一次也会被跳过
+    bool cancel(TimerState* state);
+    // 停止定时线程，丢弃所有未到期的定时任务
+    void stop();
+
+    // 时间点与tick之间的换算，向上取整保证不会提前执行
+    uint64_t toTick(std::chrono::steady_clock::time_point when) const;
+    uint64_t toTicks(std::chrono::steady_clock::duration duration) const;
+
+private:
+    void timerFunc();
+    void fire(const std::shared_ptr<TimerState>& state);
+
+    ThreadPool& m_pool;
+    const std::chrono::steady_clock::time_point m_base; // tick 0 对应的时间点
+    TimerWheel m_wheel;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_running;
+    bool m_stopped;
+};
+
+} // namespace detail
+
+#endif